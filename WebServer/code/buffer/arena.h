@@ -0,0 +1,29 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <memory_resource>
+
+// 每个连接一块的内存区：处理一个请求期间的临时数据(表单、文件的完整路径、错误页面等)依次从中切分，
+// 不逐个释放，请求和响应处理完后整体回收。先用对象内的初始空间，不够时才向系统申请，
+// 所以稳定运行的keep-alive请求不调用malloc，各线程之间也不再争用分配器
+class Arena {
+public:
+    Arena() : resource_(initial_, sizeof(initial_), std::pmr::new_delete_resource()) {}
+    ~Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // 交给std::pmr容器使用的分配器
+    std::pmr::memory_resource* Resource() { return &resource_; }
+
+    // 回收全部内存，之前分配出去的对象都不能再使用；向系统申请的额外空间同时归还
+    void Reset() { resource_.release(); }
+
+private:
+    static const size_t INITIAL_SIZE = 4096;
+    alignas(std::max_align_t) char initial_[INITIAL_SIZE];
+    std::pmr::monotonic_buffer_resource resource_;
+};
+
+#endif //ARENA_H
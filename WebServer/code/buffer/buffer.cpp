@@ -23,6 +23,10 @@ const char* Buffer::Peek() const {
     return BeginPtr_() + readPos_;
 }
 
+char* Buffer::Peek() {
+    return BeginPtr_() + readPos_;
+}
+
 // 读指针向右移动，取回可用的空间
 void Buffer::Retrieve(size_t len) {
     assert(len <= ReadableBytes());
@@ -66,8 +70,9 @@ void Buffer::HasWritten(size_t len) {
 
 // Append()函数重载
 
-void Buffer::Append(const std::string& str) {
-    // str.data()将string类型转化成char *
+void Buffer::Append(std::string_view str) {
+    // 字符串常量、string都可以直接追加，不构造临时的string
+    if(str.empty()) { return; }
     Append(str.data(), str.length());
 }
 
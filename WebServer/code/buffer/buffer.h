@@ -5,6 +5,7 @@
 #include <unistd.h>  // write
 #include <sys/uio.h> //readv
 #include <vector> //readv
+#include <string_view>
 #include <atomic>
 #include <assert.h>
 class Buffer {
@@ -17,6 +18,7 @@ public:
     size_t PrependableBytes() const;
 
     const char* Peek() const;
+    char* Peek();   // 可以原地修改未读的数据，如解码chunked请求体
     void EnsureWriteable(size_t len);
     void HasWritten(size_t len);
 
@@ -29,7 +31,7 @@ public:
     const char* BeginWriteConst() const;
     char* BeginWrite();
 
-    void Append(const std::string& str);
+    void Append(std::string_view str);
     void Append(const char* str, size_t len);
     void Append(const void* data, size_t len);
     void Append(const Buffer& buff);
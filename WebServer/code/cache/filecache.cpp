@@ -0,0 +1,341 @@
+#include "filecache.h"
+using namespace std;
+
+FileCache::File::~File() {
+    if(mapped_) {
+        munmap(const_cast<char*>(data), st.st_size);
+    }
+    if(fd >= 0) {
+        close(fd);
+    }
+}
+
+FileCache::FileCache() : compressor_(1) {
+    shardBytes_ = 0;
+    mapMax_ = SIZE_MAX;
+    headerMaker_ = nullptr;
+    for(Shard& shard: shards_) {
+        shard.hand = shard.bytes = 0;
+        shard.gen = 0;
+    }
+}
+
+FileCache* FileCache::Instance() {
+    static FileCache cache;
+    return &cache;
+}
+
+void FileCache::Init(size_t maxBytes, size_t mapMax, HeaderMaker headerMaker) {
+    InvalidateAll();
+    shardBytes_ = maxBytes / SHARD_NUM;
+    mapMax_ = mapMax;
+    headerMaker_ = headerMaker;
+}
+
+FileCache::Shard& FileCache::ShardOf_(string_view path) {
+    return shards_[hash<string_view>()(path) % SHARD_NUM];
+}
+
+// 按字面规范化路径：合并重复的'/'，去掉"."，".."退回上一级(不超过开头)，保留末尾的'/'，
+// 同一个文件不同的写法对应同一个条目，失效时才能找到；结果以'\0'结尾写进out，太长时返回0
+size_t FileCache::Normalize_(string_view path, char* out) {
+    size_t n = 0, base = 0;
+    if(!path.empty() && path[0] == '/') {
+        out[n++] = '/';
+        base = 1;
+    }
+    bool isDir = !path.empty() && path.back() == '/';
+    size_t i = 0;
+    while(i < path.size()) {
+        while(i < path.size() && path[i] == '/') { i++; }
+        size_t start = i;
+        while(i < path.size() && path[i] != '/') { i++; }
+        string_view seg = path.substr(start, i - start);
+        if(seg.empty()) { break; }
+        isDir = (seg == "." || seg == "..");
+        if(seg == ".") { continue; }
+        if(seg == "..") {
+            while(n > base && out[n - 1] != '/') { n--; }
+            if(n > base) { n--; }
+            continue;
+        }
+        if(n + seg.size() + 2 >= PATH_MAX) { return 0; }
+        if(n > base) { out[n++] = '/'; }
+        memcpy(out + n, seg.data(), seg.size());
+        n += seg.size();
+    }
+    if(isDir && n > base) { out[n++] = '/'; }
+    out[n] = '\0';
+    return n;
+}
+
+FileCache::FilePtr FileCache::Get(string_view rawPath) {
+    char key[PATH_MAX];
+    size_t keyLen = Normalize_(rawPath, key);
+    if(keyLen == 0) { return nullptr; }
+    string_view path(key, keyLen);
+    Shard& shard = ShardOf_(path);
+    uint64_t gen;
+    {
+        lock_guard<mutex> locker(shard.mtx);
+        auto it = shard.index.find(path);
+        if(it != shard.index.end()) {
+            Slot& slot = shard.slots[it->second];
+            slot.referenced = true;
+            return slot.file;
+        }
+        gen = shard.gen;
+    }
+    // 打开文件时不持有锁，同一个文件同时未命中时可能打开两次，只有一个会留在缓存里
+    shared_ptr<File> file = Load_(path);
+    if(!file) { return nullptr; }
+    // 校验值和响应头和文件一起缓存，命中时不再拼接
+    if(file->data || file->fd >= 0) {
+        file->etag = ETag_(file->st);
+        if(headerMaker_) { file->header = headerMaker_(*file); }
+    }
+    size_t size = file->st.st_size;
+    // 缓存关闭时或者比整个分片还大的文件不缓存，响应发完就释放
+    if(shardBytes_ == 0 || size > shardBytes_) { return file; }
+
+    lock_guard<mutex> locker(shard.mtx);
+    // 打开期间这个分片有条目失效过，读到的可能是改动之前的内容，这次不缓存
+    if(shard.gen != gen) { return file; }
+    auto it = shard.index.find(path);
+    if(it != shard.index.end()) {
+        Slot& slot = shard.slots[it->second];
+        slot.referenced = true;
+        return slot.file;
+    }
+    Evict_(shard, size);
+    size_t idx;
+    if(!shard.freeSlots.empty()) {
+        idx = shard.freeSlots.back();
+        shard.freeSlots.pop_back();
+    } else {
+        idx = shard.slots.size();
+        shard.slots.push_back(Slot());
+    }
+    shard.slots[idx] = { file, true, size };
+    shard.index[file->path] = idx;
+    shard.bytes += size;
+    return file;
+}
+
+void FileCache::Invalidate(string_view rawPath) {
+    char key[PATH_MAX];
+    size_t keyLen = Normalize_(rawPath, key);
+    if(keyLen == 0) { return; }
+    string_view path(key, keyLen);
+    Shard& shard = ShardOf_(path);
+    lock_guard<mutex> locker(shard.mtx);
+    shard.gen++;
+    auto it = shard.index.find(path);
+    if(it != shard.index.end()) {
+        LOG_DEBUG("FileCache invalidate %s", key);
+        Remove_(shard, it->second);
+    }
+}
+
+// 已经被取走的条目由持有者继续使用，最后一个引用放开时才关闭和解除映射
+void FileCache::InvalidateAll() {
+    for(Shard& shard: shards_) {
+        lock_guard<mutex> locker(shard.mtx);
+        shard.gen++;
+        for(Slot& slot: shard.slots) {
+            if(slot.file) { slot.file->stale_.store(true, memory_order_relaxed); }
+        }
+        shard.index.clear();
+        shard.slots.clear();
+        shard.freeSlots.clear();
+        shard.hand = shard.bytes = 0;
+    }
+}
+
+FileCache::FilePtr FileCache::GetGzip(const FilePtr& file) {
+    int state = file->gzipState_.load(memory_order_acquire);
+    if(state == GZIP_DONE) { return file->gzip_; }
+    // 只有第一个请求去找.gz文件或者提交压缩，其他请求不等待，先发原文件
+    if(state != GZIP_NONE || !file->gzipState_.compare_exchange_strong(state, GZIP_PENDING)) {
+        return nullptr;
+    }
+    FilePtr gzip = LoadGzip_(*file);
+    if(gzip || !file->data || static_cast<size_t>(file->st.st_size) > GZIP_MAX) {
+        SetGzip_(file, move(gzip));
+        return file->gzip_;
+    }
+    // 没有缓存的文件每次请求都是新的条目，不压缩，免得每次请求都压缩一遍
+    {
+        Shard& shard = ShardOf_(file->path);
+        lock_guard<mutex> locker(shard.mtx);
+        auto it = shard.index.find(file->path);
+        if(it == shard.index.end() || shard.slots[it->second].file != file) {
+            file->gzipState_.store(GZIP_DONE, memory_order_release);
+            return nullptr;
+        }
+    }
+    // 任务持有条目的引用，压缩期间被淘汰或失效也不影响
+    compressor_.AddTask([this, file] { SetGzip_(file, Compress_(*file)); });
+    return nullptr;
+}
+
+// 保存gzip版本，条目还在缓存里时把它的大小算进去，超过上限就淘汰
+void FileCache::SetGzip_(const FilePtr& file, FilePtr gzip) {
+    file->gzip_ = move(gzip);
+    file->gzipState_.store(GZIP_DONE, memory_order_release);
+    if(!file->gzip_) { return; }
+    Shard& shard = ShardOf_(file->path);
+    lock_guard<mutex> locker(shard.mtx);
+    auto it = shard.index.find(file->path);
+    if(it != shard.index.end() && shard.slots[it->second].file == file) {
+        size_t size = file->gzip_->st.st_size;
+        shard.slots[it->second].bytes += size;
+        shard.bytes += size;
+        Evict_(shard, 0);
+    }
+}
+
+// CLOCK：指针转过的条目，访问位为1的清零后跳过，为0的淘汰，直到放得下need字节
+void FileCache::Evict_(Shard& shard, size_t need) {
+    while(shard.bytes + need > shardBytes_ && !shard.index.empty()) {
+        if(shard.hand >= shard.slots.size()) { shard.hand = 0; }
+        size_t idx = shard.hand++;
+        Slot& slot = shard.slots[idx];
+        if(!slot.file) { continue; }
+        if(slot.referenced) {
+            slot.referenced = false;
+            continue;
+        }
+        LOG_DEBUG("FileCache evict %s", slot.file->path.c_str());
+        Remove_(shard, idx);
+    }
+}
+
+void FileCache::Remove_(Shard& shard, size_t idx) {
+    Slot& slot = shard.slots[idx];
+    // 索引的键指向条目中的路径，先删索引再释放条目
+    shard.index.erase(slot.file->path);
+    shard.bytes -= slot.bytes;
+    slot.file->stale_.store(true, memory_order_relaxed);
+    slot.file.reset();
+    shard.freeSlots.push_back(idx);
+}
+
+// 找"路径.gz"文件，没有时返回nullptr
+FileCache::FilePtr FileCache::LoadGzip_(const File& file) const {
+    if(!file.data && file.fd < 0) { return nullptr; }
+    char gzPath[PATH_MAX];
+    int len = snprintf(gzPath, sizeof(gzPath), "%s.gz", file.path.c_str());
+    if(len > 0 && static_cast<size_t>(len) < sizeof(gzPath)) {
+        shared_ptr<File> gz = Load_(gzPath);
+        if(gz && (gz->data || gz->fd >= 0)) {
+            // 类型按原文件，修改时间和校验值按.gz文件
+            gz->path = file.path;
+            gz->encoding = "gzip";
+            gz->etag = ETag_(gz->st);
+            if(headerMaker_) { gz->header = headerMaker_(*gz); }
+            return gz;
+        }
+    }
+    return nullptr;
+}
+
+// 压缩内存中的内容，在后台线程中执行
+FileCache::FilePtr FileCache::Compress_(const File& file) const {
+    size_t size = file.st.st_size;
+    // windowBits加16输出gzip格式；默认级别(6)的压缩率和最高级别差不多，耗时少得多
+    z_stream zs = {};
+    if(deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return nullptr;
+    }
+    size_t bound = deflateBound(&zs, size);
+    unique_ptr<char[]> out(new char[bound]);
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(file.data));
+    zs.avail_in = size;
+    zs.next_out = reinterpret_cast<Bytef*>(out.get());
+    zs.avail_out = bound;
+    int ret = deflate(&zs, Z_FINISH);
+    size_t outLen = zs.total_out;
+    deflateEnd(&zs);
+    if(ret != Z_STREAM_END || outLen >= size) { return nullptr; }
+
+    auto gz = make_shared<File>();
+    gz->path = file.path;
+    gz->st = file.st;
+    gz->st.st_size = outLen;
+    gz->encoding = "gzip";
+    gz->inline_ = move(out);
+    gz->data = gz->inline_.get();
+    // 和原文件的校验值区分开，原文件变化时跟着变
+    gz->etag = file.etag;
+    gz->etag.insert(gz->etag.size() - 1, "-gz");
+    if(headerMaker_) { gz->header = headerMaker_(*gz); }
+    LOG_DEBUG("FileCache gzip %s %zu -> %zu", file.path.c_str(), size, outLen);
+    return gz;
+}
+
+// 文件被替换(inode变)、修改(修改时间到纳秒、大小变)后校验值都会改变
+string FileCache::ETag_(const struct stat& st) {
+    char etag[64];
+    int len = snprintf(etag, sizeof(etag), "\"%lx-%lx-%lx\"",
+                       (unsigned long)st.st_ino, (unsigned long)st.st_size,
+                       (unsigned long)st.st_mtim.tv_sec * 1000000000UL + st.st_mtim.tv_nsec);
+    return string(etag, len);
+}
+
+// 打开文件：小文件读进内存后关闭，较大的文件映射到内存并保持打开，超过mapMax_的只保持打开
+shared_ptr<FileCache::File> FileCache::Load_(string_view path) const {
+    // 先在栈上拼出以'\0'结尾的路径stat，不存在的文件(如扫描404的请求)不分配条目
+    char cpath[PATH_MAX];
+    struct stat st;
+    if(path.size() >= sizeof(cpath)) { return nullptr; }
+    memcpy(cpath, path.data(), path.size());
+    cpath[path.size()] = '\0';
+    if(stat(cpath, &st) < 0 || !S_ISREG(st.st_mode)) {
+        return nullptr;
+    }
+    auto file = make_shared<File>();
+    file->path.assign(path);
+    file->st = st;
+    // 没有权限，不打开
+    if(!(file->st.st_mode & S_IROTH)) {
+        return file;
+    }
+    int fd = open(file->path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) { return nullptr; }
+    // stat之后文件可能被替换，以打开的文件为准
+    if(fstat(fd, &file->st) < 0 || !S_ISREG(file->st.st_mode)) {
+        close(fd);
+        return nullptr;
+    }
+    size_t size = file->st.st_size;
+    if(size <= INLINE_MAX) {
+        file->inline_.reset(new char[size + 1]);
+        size_t done = 0;
+        while(done < size) {
+            ssize_t len = pread(fd, file->inline_.get() + done, size - done, done);
+            if(len <= 0) { break; }
+            done += len;
+        }
+        close(fd);
+        // 读的过程中文件被截短，只用读到的部分
+        file->st.st_size = done;
+        file->data = file->inline_.get();
+        return file;
+    }
+    if(size > mapMax_) {
+        file->fd = fd;
+        return file;
+    }
+    /* 将文件映射到内存提高文件的访问速度
+        MAP_PRIVATE 建立一个写入时拷贝的私有映射*/
+    void* mmRet = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(mmRet == MAP_FAILED) {
+        close(fd);
+        return nullptr;
+    }
+    file->fd = fd;
+    file->data = static_cast<char*>(mmRet);
+    file->mapped_ = true;
+    return file;
+}
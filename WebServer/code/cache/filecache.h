@@ -0,0 +1,128 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <zlib.h>        // deflate
+#include <stdint.h>      // SIZE_MAX
+#include <string.h>      // memcpy
+#include <stdio.h>       // snprintf
+#include <limits.h>      // PATH_MAX
+#include <fcntl.h>       // open
+#include <unistd.h>      // close, pread
+#include <sys/stat.h>    // stat
+#include <sys/mman.h>    // mmap, munmap
+
+#include "../log/log.h"
+#include "../pool/threadpool.h"
+
+// 进程内共享的静态文件缓存：按完整路径保存打开的文件、stat信息和内存映射，
+// 同一个文件被反复请求时不再每次stat、open、mmap、munmap；小文件直接读进内存，不占用映射和fd
+// 条目用shared_ptr管理，被淘汰或失效后，正在发送它的响应仍然持有引用，发完才真正释放
+// 按路径哈希分成多个分片，各自加锁，各分片的总大小有上限，超过时按CLOCK算法淘汰
+class FileCache {
+public:
+    // 缓存的一个文件，创建后只读
+    struct File {
+        std::string path;       // 完整路径
+        struct stat st;         // 文件的状态信息
+        int fd;                 // 映射的文件和大文件保持打开，内联的小文件和没有权限的文件为-1
+        const char* data;       // 文件内容，没有读权限时为nullptr；超过mapMax的大文件也不映射，只用fd发送
+        std::string etag;       // 由inode、大小和修改时间生成的强校验值，带双引号，没有读权限的文件为空
+        std::string header;     // 加载时由HeaderMaker生成一次的响应头(类型、长度等)，没有读权限的文件为空
+        const char* encoding;   // 内容编码，原文件为nullptr，gzip版本为"gzip"
+
+        File() : st{}, fd(-1), data(nullptr), encoding(nullptr), mapped_(false), gzipState_(GZIP_NONE), stale_(false) {}
+        ~File();
+        File(const File&) = delete;
+        File& operator=(const File&) = delete;
+
+        // 条目已经被淘汰或失效，再Get一次可能得到新的内容；从来没有放进缓存的条目总是false
+        bool IsStale() const { return stale_.load(std::memory_order_relaxed); }
+    private:
+        friend class FileCache;
+        bool mapped_;                       // data是mmap的地址
+        std::unique_ptr<char[]> inline_;    // 小文件的内容，或者压缩后的内容
+        // gzip版本在第一次需要时生成一次，之后跟着这个条目缓存、淘汰
+        // gzip_只在gzipState_变成GZIP_DONE之前写一次，之后只读
+        mutable std::atomic<int> gzipState_;
+        mutable std::shared_ptr<const File> gzip_;
+        mutable std::atomic<bool> stale_;
+    };
+    typedef std::shared_ptr<const File> FilePtr;
+    // 文件打开后调用一次，生成这个文件的响应头，之后每个响应直接复制
+    typedef std::string (*HeaderMaker)(const File& file);
+
+    // 单例模式
+    static FileCache* Instance();
+
+    // 设置缓存的总大小(字节)，0为不缓存(每次都重新打开)；超过mapMax字节的文件不映射，
+    // 由调用者用sendfile直接从fd发送；headerMaker为空时不生成响应头；同时清空已有的条目
+    void Init(size_t maxBytes, size_t mapMax = SIZE_MAX, HeaderMaker headerMaker = nullptr);
+
+    // 取文件，没有缓存时打开并加入缓存；文件不存在或不是普通文件时返回nullptr
+    // 路径按字面规范化后作为键，不同的写法(如"a//b"、"a/./b")是同一个条目
+    // 没有其他用户读权限的文件只有stat信息(data为nullptr)，由调用者返回403
+    FilePtr Get(std::string_view path);
+
+    // 取文件的gzip版本：有"路径.gz"的文件时直接用它，否则把缓存中的文件用zlib压缩一次；
+    // 压缩在后台线程进行，不阻塞事件循环，压缩完成之前返回nullptr，调用者先发原文件
+    // 压缩结果算在原文件的条目里，一起受缓存大小的限制；压缩后没有变小或者不能压缩时返回nullptr
+    // gzip版本的path、类型和原文件相同，encoding为"gzip"，有自己的校验值
+    FilePtr GetGzip(const FilePtr& file);
+
+    // 文件被修改或删除后让它的条目(连同gzip版本)失效，下次Get时重新打开；
+    // 正在发送它的响应仍然持有引用，文件内容和映射在发完之前一直有效
+    void Invalidate(std::string_view path);
+    // 所有条目失效，目录被移动、删除或者监视丢失事件时使用
+    void InvalidateAll();
+
+    static const size_t INLINE_MAX = 16 * 1024;     // 不超过这个大小的文件读进内存，不做映射
+    static const size_t GZIP_MAX = 1024 * 1024;     // 超过这个大小又没有.gz文件的不压缩
+
+private:
+    FileCache();
+    ~FileCache() = default;
+
+    static const int SHARD_NUM = 16;
+    // File::gzipState_
+    enum { GZIP_NONE = 0, GZIP_PENDING, GZIP_DONE };
+
+    struct Slot {
+        FilePtr file;           // 空表示空闲的槽
+        bool referenced;        // CLOCK的访问位
+        size_t bytes;           // 文件和它的gzip版本的总大小
+    };
+    struct Shard {
+        std::mutex mtx;
+        std::unordered_map<std::string_view, size_t> index;    // 路径(指向条目自己的path) - 槽
+        std::vector<Slot> slots;            // CLOCK的环
+        std::vector<size_t> freeSlots;
+        size_t hand;            // CLOCK的指针
+        size_t bytes;           // 缓存文件的总大小
+        uint64_t gen;           // 每次失效加一，打开文件期间有过失效时不放进缓存
+    };
+
+    std::shared_ptr<File> Load_(std::string_view path) const;
+    static std::string ETag_(const struct stat& st);
+    FilePtr LoadGzip_(const File& file) const;
+    FilePtr Compress_(const File& file) const;
+    void SetGzip_(const FilePtr& file, FilePtr gzip);
+    Shard& ShardOf_(std::string_view path);
+    static size_t Normalize_(std::string_view path, char* out);
+    void Evict_(Shard& shard, size_t need);
+    void Remove_(Shard& shard, size_t slot);
+
+    Shard shards_[SHARD_NUM];
+    size_t shardBytes_;         // 每个分片的大小上限
+    size_t mapMax_;             // 映射到内存的文件大小上限
+    HeaderMaker headerMaker_;
+    ThreadPool compressor_;     // 压缩文件的后台线程
+};
+
+#endif //FILE_CACHE_H
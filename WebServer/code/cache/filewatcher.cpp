@@ -0,0 +1,128 @@
+#include "filewatcher.h"
+using namespace std;
+
+FileWatcher::FileWatcher() : inotifyFd_(-1), stopFd_(-1) {}
+
+FileWatcher::~FileWatcher() {
+    Stop();
+}
+
+bool FileWatcher::Start(const string& dir) {
+    if(inotifyFd_ >= 0) { return true; }
+    inotifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    stopFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(inotifyFd_ < 0 || stopFd_ < 0) {
+        LOG_ERROR("FileWatcher init error: %d", errno);
+        Stop();
+        return false;
+    }
+    AddWatch_(dir);
+    if(dirs_.empty()) {
+        Stop();
+        return false;
+    }
+    thread_ = thread(&FileWatcher::Loop_, this);
+    return true;
+}
+
+void FileWatcher::Stop() {
+    if(thread_.joinable()) {
+        uint64_t one = 1;
+        ssize_t ret = write(stopFd_, &one, sizeof(one));
+        (void)ret;
+        thread_.join();
+    }
+    if(inotifyFd_ >= 0) { close(inotifyFd_); }
+    if(stopFd_ >= 0) { close(stopFd_); }
+    inotifyFd_ = stopFd_ = -1;
+    dirs_.clear();
+}
+
+// 符号链接的目录不跟进去，免得成环
+void FileWatcher::AddWatch_(const string& dir) {
+    string path = dir;
+    if(path.empty() || path.back() != '/') { path += '/'; }
+    int wd = inotify_add_watch(inotifyFd_, path.c_str(), DIR_MASK);
+    if(wd < 0) {
+        // 超过fs.inotify.max_user_watches时返回ENOSPC，这个目录下的文件不会自动失效
+        LOG_WARN("FileWatcher watch %s error: %d", path.c_str(), errno);
+        return;
+    }
+    dirs_[wd] = path;
+    DIR* d = opendir(path.c_str());
+    if(!d) { return; }
+    while(struct dirent* entry = readdir(d)) {
+        if(strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) { continue; }
+        bool isDir = entry->d_type == DT_DIR;
+        if(entry->d_type == DT_UNKNOWN) {
+            struct stat st;
+            isDir = lstat((path + entry->d_name).c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+        }
+        if(isDir) { AddWatch_(path + entry->d_name); }
+    }
+    closedir(d);
+}
+
+void FileWatcher::Loop_() {
+    // inotify_event后面跟着变长的文件名，缓冲区要按它对齐
+    alignas(struct inotify_event) char buf[4096];
+    struct pollfd fds[2] = { { inotifyFd_, POLLIN, 0 }, { stopFd_, POLLIN, 0 } };
+    while(true) {
+        if(poll(fds, 2, -1) < 0) {
+            if(errno == EINTR) { continue; }
+            LOG_ERROR("FileWatcher poll error: %d", errno);
+            break;
+        }
+        if(fds[1].revents) { break; }
+        while(true) {
+            ssize_t len = read(inotifyFd_, buf, sizeof(buf));
+            if(len <= 0) { break; }
+            for(char* p = buf; p < buf + len; ) {
+                auto event = reinterpret_cast<const struct inotify_event*>(p);
+                Handle_(event);
+                p += sizeof(struct inotify_event) + event->len;
+            }
+        }
+    }
+}
+
+void FileWatcher::Handle_(const struct inotify_event* event) {
+    FileCache* cache = FileCache::Instance();
+    // 事件队列溢出，丢了哪些事件不知道，全部失效
+    if(event->mask & IN_Q_OVERFLOW) {
+        LOG_WARN("FileWatcher queue overflow, invalidate all");
+        cache->InvalidateAll();
+        return;
+    }
+    if(event->mask & IN_IGNORED) {
+        dirs_.erase(event->wd);
+        return;
+    }
+    auto it = dirs_.find(event->wd);
+    if(it == dirs_.end()) { return; }
+    // 被监视的目录自己被删除或移走，它下面的条目不好逐个找，全部失效
+    if(event->mask & IN_DELETE_SELF) {
+        cache->InvalidateAll();
+        return;
+    }
+    if(event->len == 0) { return; }
+    string path = it->second + event->name;
+    if(event->mask & IN_ISDIR) {
+        if(event->mask & (IN_CREATE | IN_MOVED_TO)) {
+            // 新建或移进来的子目录也要监视
+            AddWatch_(path);
+        }
+        if(event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+            LOG_INFO("FileWatcher dir %s removed, invalidate all", path.c_str());
+            cache->InvalidateAll();
+        }
+        return;
+    }
+    LOG_DEBUG("FileWatcher %s changed, mask %x", path.c_str(), event->mask);
+    cache->Invalidate(path);
+    // .gz文件变化时，用它作为gzip版本的原文件也要失效
+    size_t len = path.size();
+    if(len > 3 && path.compare(len - 3, 3, ".gz") == 0) {
+        cache->Invalidate(string_view(path).substr(0, len - 3));
+    }
+}
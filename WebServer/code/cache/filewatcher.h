@@ -0,0 +1,43 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <string>
+#include <unordered_map>
+#include <thread>
+#include <dirent.h>          // opendir, readdir
+#include <poll.h>            // poll
+#include <unistd.h>          // read, close
+#include <errno.h>
+#include <sys/inotify.h>     // inotify_init1, inotify_add_watch
+#include <sys/eventfd.h>     // eventfd
+
+#include "filecache.h"
+#include "../log/log.h"
+
+// 用inotify监视资源目录(包括子目录)，文件被修改、替换、删除或者改变权限时让文件缓存中的条目失效，
+// 部署时直接覆盖resources/下的文件即可生效，不用重启，也不用每个请求都stat一次
+// 监视在单独的线程中进行，只调用FileCache的Invalidate，不碰正在发送的响应
+class FileWatcher {
+public:
+    FileWatcher();
+    ~FileWatcher();
+
+    // 开始监视dir及其下所有子目录，失败时返回false，缓存照常工作只是不会自动失效
+    bool Start(const std::string& dir);
+    void Stop();
+
+private:
+    void AddWatch_(const std::string& dir);     // 监视dir和它下面的所有子目录
+    void Loop_();
+    void Handle_(const struct inotify_event* event);
+
+    static const uint32_t DIR_MASK = IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE |
+                                     IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_ONLYDIR;
+
+    int inotifyFd_;
+    int stopFd_;                                    // 写入后监视线程退出
+    std::thread thread_;
+    std::unordered_map<int, std::string> dirs_;     // 监视描述符 - 目录路径(以'/'结尾)
+};
+
+#endif //FILE_WATCHER_H
@@ -5,11 +5,15 @@ const char* HttpConn::srcDir;
 std::atomic<int> HttpConn::userCount;
 // 静态成员函数？
 bool HttpConn::isET;
+int HttpConn::maxPipeline = 16;
 
 HttpConn::HttpConn() { 
     fd_ = -1;
     addr_ = { 0 };
     isClose_ = true;
+    iovIdx_ = fileIdx_ = toWrite_ = respCnt_ = 0;
+    isKeepAlive_ = false;
+    request_.SetArena(arena_.Resource());
 };
 
 HttpConn::~HttpConn() { 
@@ -26,12 +30,19 @@ void HttpConn::init(int fd, const sockaddr_in& addr) {
     // 初始化写缓冲和读缓冲
     writeBuff_.RetrieveAll();
     readBuff_.RetrieveAll();
+    // 连接槽会被复用，丢弃上一个连接没有解析完的请求和没有写完的响应
+    request_.Init();
+    arena_.Reset();
+    iov_.clear();
+    fileSegs_.clear();
+    iovIdx_ = fileIdx_ = toWrite_ = respCnt_ = 0;
+    isKeepAlive_ = false;
     isClose_ = false;
     LOG_INFO("Client[%d](%s:%d) in, userCount:%d", fd_, GetIP(), GetPort(), (int)userCount);
 }
 
 void HttpConn::Close() {
-    response_.UnmapFile();  // 解除内存映射
+    UnmapFiles_();  // 解除内存映射
     if(isClose_ == false){
         isClose_ = true; 
         userCount--;
@@ -75,67 +86,172 @@ ssize_t HttpConn::write(int* saveErrno) {
     ssize_t len = -1;
     // 一次性写完
     do {
-        // 分散写数据
-        len = writev(fd_, iov_, iovCnt_);
-        if(len <= 0) {
-        // 没有数据写了或者报错
-            *saveErrno = errno;
-            break;
-        }
-        // 这种情况是所有数据都传输结束了
-        if(iov_[0].iov_len + iov_[1].iov_len  == 0) { break; } /* 传输结束 */
-        // 写到了第二块内存，做相应的处理
-        else if(static_cast<size_t>(len) > iov_[0].iov_len) {
-            iov_[1].iov_base = (uint8_t*) iov_[1].iov_base + (len - iov_[0].iov_len);
-            iov_[1].iov_len -= (len - iov_[0].iov_len);
-            if(iov_[0].iov_len) {
-                // 写完之后做一个数据清除
-                // 清除写缓冲区
-                writeBuff_.RetrieveAll();
-                iov_[0].iov_len = 0;
+        int flags = 0;
+        const struct msghdr* msg = NextMsg(&flags);
+        if(msg == nullptr) {
+            len = SendFile(saveErrno);
+            if(len <= 0) { break; }
+        } else {
+            // 分散写数据，与writev相同，但对端已关闭时返回EPIPE而不是触发SIGPIPE杀掉进程
+            len = sendmsg(fd_, msg, flags | MSG_NOSIGNAL);
+            if(len <= 0) {
+            // 没有数据写了或者报错
+                *saveErrno = errno;
+                break;
             }
+            HasSent(len);
         }
-        // 还没有写到第二块内存的数据
-        else {
-            iov_[0].iov_base = (uint8_t*)iov_[0].iov_base + len; 
-            iov_[0].iov_len -= len; 
-            writeBuff_.Retrieve(len);
-        }
+        // 这种情况是所有数据都传输结束了
+        if(toWrite_ == 0) { break; }
     } while(isET || ToWriteBytes() > 10240);  // 边沿触发模式时或者待写的数据比较多
     return len;
 }
 
-// 业务逻辑处理
-bool HttpConn::process() {
-    // 初始化请求对象
-    request_.Init();
-    
-    if(readBuff_.ReadableBytes() <= 0) {// 没有请求数据
-        return false;
+const struct msghdr* HttpConn::NextMsg(int* flags) {
+    assert(iovIdx_ < iov_.size());
+    if(iov_[iovIdx_].iov_base == nullptr) { return nullptr; }
+    // 一次写到下一个sendfile的文件为止，后面还有文件时带上MSG_MORE，让响应头和文件开头合并成满的报文段
+    size_t end = iovIdx_;
+    while(end < iov_.size() && iov_[end].iov_base != nullptr && end - iovIdx_ < IOV_MAX) { end++; }
+    msg_ = { 0 };
+    msg_.msg_iov = iov_.data() + iovIdx_;
+    msg_.msg_iovlen = end - iovIdx_;
+    *flags = (end < iov_.size() && iov_[end].iov_base == nullptr ? MSG_MORE: 0);
+    return &msg_;
+}
+
+void HttpConn::HasSent(size_t len) {
+    toWrite_ -= len;
+    // 跳过已经写完的内存块，写了一部分的调整起始位置
+    while(len > 0 && len >= iov_[iovIdx_].iov_len) {
+        len -= iov_[iovIdx_].iov_len;
+        iovIdx_++;
     }
-    else if(request_.parse(readBuff_)) {    // 解析请求数据
-        LOG_DEBUG("%s", request_.path().c_str());
-        // 解析玩请求数据以后（解析成功），初始化响应对象
-        response_.Init(srcDir, request_.path(), request_.IsKeepAlive(), 200);
-    } else {
-        // 解析失败
-        response_.Init(srcDir, request_.path(), false, 400);
+    if(len > 0) {
+        iov_[iovIdx_].iov_base = (uint8_t*)iov_[iovIdx_].iov_base + len;
+        iov_[iovIdx_].iov_len -= len;
     }
+    // 所有数据都传输结束了，清除写缓冲区
+    if(toWrite_ == 0) { writeBuff_.RetrieveAll(); }
+}
 
-    // 生成响应信息（writeBuff_中保存着响应的一些信息）
-    response_.MakeResponse(writeBuff_);
+ssize_t HttpConn::SendFile(int* saveErrno) {
+    assert(iov_[iovIdx_].iov_base == nullptr);
+    // 大文件由内核从页缓存直接发给套接字，不映射也不拷贝到用户态，偏移量随发送前进
+    FileSeg& seg = fileSegs_[fileIdx_];
+    ssize_t len = sendfile(fd_, seg.fd, &seg.offset, iov_[iovIdx_].iov_len);
+    if(len <= 0) {
+        // 返回0说明文件在发送过程中被截短，Content-length已经发出，只能关闭连接
+        *saveErrno = (len == 0 ? EIO: errno);
+        return len;
+    }
+    toWrite_ -= len;
+    iov_[iovIdx_].iov_len -= len;
+    if(iov_[iovIdx_].iov_len == 0) {
+        iovIdx_++;
+        fileIdx_++;
+    }
+    if(toWrite_ == 0) { writeBuff_.RetrieveAll(); }
+    return len;
+}
 
-    /* 响应头 */
-    iov_[0].iov_base = const_cast<char*>(writeBuff_.Peek());
-    iov_[0].iov_len = writeBuff_.ReadableBytes();
-    iovCnt_ = 1;
+// 业务逻辑处理，一次处理读缓冲区中所有完整的请求，没有完整的请求时返回false，继续读
+bool HttpConn::process() {
+    // 上一批已经写完，解除它们的文件映射
+    UnmapFiles_();
+    respCnt_ = 0;
+    headEnd_.clear();
+    isKeepAlive_ = false;
+    while(respCnt_ < static_cast<size_t>(maxPipeline) && readBuff_.ReadableBytes() > 0) {
+        // 解析请求数据，请求对象保存着解析进度，下次读到数据后接着解析
+        HttpRequest::HTTP_CODE ret = request_.parse(readBuff_);
+        if(ret == HttpRequest::NO_REQUEST) { break; }
+        HttpResponse& response = NextResponse_();
+        if(ret == HttpRequest::GET_REQUEST) {
+            LOG_DEBUG("%s", request_.path().c_str());
+            // 解析玩请求数据以后（解析成功），初始化响应对象
+            response.Init(srcDir, request_.path(), request_.IsKeepAlive(), 200);
+            // 只有GET和HEAD可以用缓存的文件回304，以及协商压缩
+            string method = request_.method();
+            if(method == "GET" || method == "HEAD") {
+                response.SetConditional(request_.GetHeader(HttpRequest::IF_NONE_MATCH),
+                                        request_.GetHeader(HttpRequest::IF_MODIFIED_SINCE));
+                response.SetAcceptEncoding(request_.GetHeader(HttpRequest::ACCEPT_ENCODING));
+            }
+            if(method == "GET") {
+                response.SetRange(request_.GetHeader(HttpRequest::RANGE),
+                                  request_.GetHeader(HttpRequest::IF_RANGE));
+            }
+            isKeepAlive_ = request_.IsKeepAlive();
+        } else {
+            // 解析失败，请求过大时返回413/431，其余为400；之后连接关闭，不再读取剩余数据
+            int code = (ret == HttpRequest::ENTITY_TOO_LARGE ? 413:
+                        ret == HttpRequest::HEADER_TOO_LARGE ? 431: 400);
+            response.Init(srcDir, request_.path(), false, code);
+            isKeepAlive_ = false;
+        }
+        // 生成响应信息（writeBuff_中保存着响应的一些信息），响应头依次追加在writeBuff_中
+        response.MakeResponse(writeBuff_);
+        headEnd_.push_back(writeBuff_.ReadableBytes());
+        // 这个请求已经处理完，先释放请求中的表单再回收内存区，下一个请求从头使用
+        request_.Init();
+        arena_.Reset();
+        // 这个响应之后连接就关闭，后面的请求不再处理
+        if(!isKeepAlive_) { break; }
+    }
+    if(respCnt_ == 0) {
+        return false;
+    }
 
-    /* 文件 */
-    if(response_.FileLen() > 0  && response_.File()) {
-        iov_[1].iov_base = response_.File();        // 响应正文中文件映射的指针
-        iov_[1].iov_len = response_.FileLen();      // 响应正文的大小，也就是文件的大小
-        iovCnt_ = 2;
+    // writeBuff_不再追加，响应头的地址确定下来以后再组织分散内存
+    iov_.clear();
+    iovIdx_ = 0;
+    fileSegs_.clear();
+    fileIdx_ = 0;
+    toWrite_ = 0;
+    size_t headBegin = 0;
+    bool lastIsHead = false;
+    for(size_t i = 0; i < respCnt_; i++) {
+        /* 响应头，上一个响应没有文件时和它的头部在writeBuff_中是连续的，合并成一块 */
+        size_t headLen = headEnd_[i] - headBegin;
+        if(lastIsHead) {
+            iov_.back().iov_len += headLen;
+        } else {
+            iov_.push_back({ const_cast<char*>(writeBuff_.Peek()) + headBegin, headLen });
+        }
+        headBegin = headEnd_[i];
+        lastIsHead = true;
+        /* 正文：文件在内存中的内容、预先生成的错误响应、多段Range的分隔行直接引用，
+           没有映射的大文件用sendfile发送，在iov_中占一个空位置，记下剩余的字节数 */
+        HttpResponse& response = *responses_[i];
+        for(const HttpResponse::Segment& seg: response.Body()) {
+            if(seg.data) {
+                iov_.push_back({ const_cast<char*>(seg.data), seg.len });
+            } else {
+                iov_.push_back({ nullptr, seg.len });
+                fileSegs_.push_back({ response.FileFd(), seg.offset });
+            }
+            toWrite_ += seg.len;
+            lastIsHead = false;
+        }
     }
-    LOG_DEBUG("filesize:%d, %d  to %d", response_.FileLen() , iovCnt_, ToWriteBytes());
+    toWrite_ += writeBuff_.ReadableBytes();
+    LOG_DEBUG("responses:%d, %d iov to %d", (int)respCnt_, (int)iov_.size(), (int)ToWriteBytes());
     return true;
 }
+
+// 取这一批的下一个响应对象，对象随连接复用
+HttpResponse& HttpConn::NextResponse_() {
+    if(respCnt_ == responses_.size()) {
+        responses_.emplace_back(new HttpResponse());
+        responses_.back()->SetArena(arena_.Resource());
+    }
+    return *responses_[respCnt_++];
+}
+
+// 解除上一批响应的文件映射
+void HttpConn::UnmapFiles_() {
+    for(size_t i = 0; i < respCnt_; i++) {
+        responses_[i]->UnmapFile();
+    }
+}
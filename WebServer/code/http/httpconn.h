@@ -3,13 +3,19 @@
 
 #include <sys/types.h>
 #include <sys/uio.h>     // readv/writev
+#include <sys/socket.h>  // sendmsg
+#include <sys/sendfile.h> // sendfile
 #include <arpa/inet.h>   // sockaddr_in
 #include <stdlib.h>      // atoi()
 #include <errno.h>      
+#include <limits.h>      // IOV_MAX
+#include <vector>
+#include <memory>
 
 #include "../log/log.h"
 #include "../pool/sqlconnRAII.h"
 #include "../buffer/buffer.h"
+#include "../buffer/arena.h"
 #include "httprequest.h"
 #include "httpresponse.h"
 
@@ -27,6 +33,21 @@ public:
 
     ssize_t write(int* saveErrno);
 
+    // 完成模式(io_uring)下由事件循环收发：收到的数据追加进读缓冲区
+    void Receive(const char* data, size_t len) {
+        readBuff_.Append(data, len);
+    }
+
+    // 下一次发送的内存数据，写到下一个sendfile的文件为止，flags为要带上的MSG_MORE；
+    // 下一段是sendfile的文件时返回nullptr，用SendFile发送；返回的msghdr在HasSent之前有效
+    const struct msghdr* NextMsg(int* flags);
+
+    // NextMsg的数据发出len字节之后调用
+    void HasSent(size_t len);
+
+    // 发送下一段sendfile的文件，返回值和saveErrno与write相同
+    ssize_t SendFile(int* saveErrno);
+
     void Close();
 
     int GetFd() const;
@@ -37,19 +58,26 @@ public:
     
     sockaddr_in GetAddr() const;
     
+    // 解析读缓冲区中所有完整的请求(最多maxPipeline个)，按顺序生成这一批响应，没有完整请求时返回false
     bool process();
 
-    int ToWriteBytes() { 
-        return iov_[0].iov_len + iov_[1].iov_len; 
+    size_t ToWriteBytes() const { 
+        return toWrite_; 
     }
 
+    // 这一批最后一个响应是否保持连接
     bool IsKeepAlive() const {
-        return request_.IsKeepAlive();
+        return isKeepAlive_;
+    }
+
+    bool IsClose() const {
+        return isClose_;
     }
     // 定义了三个静态成员函数，所有类对象共享
     static bool isET;
     static const char* srcDir;  // 资源的目录
     static std::atomic<int> userCount; // 总共的客户单的连接数
+    static int maxPipeline;     // 一批最多处理的流水线请求数
     
 private:
     // Socket连接的监听描述符
@@ -59,17 +87,38 @@ private:
     // 连接是否关闭
     bool isClose_;
     
-    int iovCnt_;    // 分散内存的数量
-    struct iovec iov_[2];   // 分散内存
+    HttpResponse& NextResponse_();  // 取这一批的下一个响应对象
+    void UnmapFiles_();             // 解除上一批响应的文件映射
+
+    // 分散内存：依次为各响应的头部(在writeBuff_中，相邻的合并)和文件，一次sendmsg写出整批响应
+    // 没有映射的大文件用sendfile发送，在这里占一个iov_base为空的位置，iov_len为剩余的字节数
+    // 容量随连接保留，稳定运行时不再分配
+    std::vector<struct iovec> iov_;
+    size_t iovIdx_;     // 第一个还没写完的iovec
+    struct FileSeg {
+        int fd;         // 文件缓存中打开的文件，响应持有条目，写完之前不会关闭
+        off_t offset;   // 下一次sendfile的位置
+    };
+    std::vector<FileSeg> fileSegs_;     // 按顺序对应iov_中的空位置
+    size_t fileIdx_;    // 第一个还没发完的文件
+    size_t toWrite_;    // 剩余待写的字节数
+    struct msghdr msg_; // NextMsg返回的消息头，异步发送时在完成之前一直被内核引用
+    bool isKeepAlive_;  // 这一批最后一个响应是否保持连接
     
     // 读写缓冲区也都封装成了一个类，用vector动态数组封装char *, 实现自动增长的缓冲区
     Buffer readBuff_;   // 读(请求)缓冲区，保存请求数据的内容
     Buffer writeBuff_;  // 写(响应)缓冲区，保存响应数据的内容
 
+    // 请求和响应处理期间的临时数据从这里分配，每处理完一个请求整体回收
+    Arena arena_;
+
     // 将请求功能和相应功能都封装成一个类
     // 在构造函数中并没有对着两个类进行初始化
     HttpRequest request_;   // 请求对象
-    HttpResponse response_; // 响应对象
+    // 这一批的响应对象，按请求顺序；对象持有文件映射，用指针保存，扩容时不会被拷贝
+    std::vector<std::unique_ptr<HttpResponse>> responses_;
+    size_t respCnt_;            // 这一批的响应数
+    std::vector<size_t> headEnd_;   // 各响应头部在writeBuff_中的结束位置
 };
 
 
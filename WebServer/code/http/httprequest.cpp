@@ -1,107 +1,235 @@
 #include "httprequest.h"
+#include "router.h"
 using namespace std;
 
-const unordered_set<string> HttpRequest::DEFAULT_HTML{
-            "/index", "/register", "/login",
-             "/welcome", "/video", "/picture", };
+// 常用请求头的名字，顺序与HEADER一致
+namespace {
 
-const unordered_map<string, int> HttpRequest::DEFAULT_HTML_TAG {
-            {"/register.html", 0}, {"/login.html", 1},  };
+constexpr const char* KNOWN_HEADER_NAME[HttpRequest::HEADER_COUNT] = {
+    "Connection", "Content-Length", "Content-Type", "Host", "Transfer-Encoding",
+    "Accept-Encoding", "If-None-Match", "If-Modified-Since", "Range", "If-Range",
+};
+
+constexpr char ToLower(char ch) {
+    return (ch >= 'A' && ch <= 'Z') ? ch - 'A' + 'a': ch;
+}
+
+constexpr size_t Length(const char* str) {
+    size_t len = 0;
+    while(str[len]) { len++; }
+    return len;
+}
+
+// 完美哈希：只用名字的长度、首字符和尾字符(不区分大小写)，常用请求头各自落在不同的槽里，
+// 解析一个请求头只需要算一次哈希、比较一次名字
+const size_t HEADER_SLOT_NUM = 16;
+constexpr size_t HeaderSlot(const char* key, size_t len) {
+    return (len + ToLower(key[0]) + ToLower(key[len - 1]) * 7) % HEADER_SLOT_NUM;
+}
+
+struct HeaderSlots {
+    int header[HEADER_SLOT_NUM];    // 槽对应的常用请求头编号，-1表示空槽
+    bool collision;                 // 是否有两个请求头落在同一个槽
+};
+
+constexpr HeaderSlots MakeHeaderSlots() {
+    HeaderSlots slots{};
+    for(size_t i = 0; i < HEADER_SLOT_NUM; i++) { slots.header[i] = -1; }
+    for(int i = 0; i < HttpRequest::HEADER_COUNT; i++) {
+        size_t slot = HeaderSlot(KNOWN_HEADER_NAME[i], Length(KNOWN_HEADER_NAME[i]));
+        if(slots.header[slot] != -1) { slots.collision = true; }
+        slots.header[slot] = i;
+    }
+    return slots;
+}
+
+constexpr HeaderSlots HEADER_SLOTS = MakeHeaderSlots();
+static_assert(!HEADER_SLOTS.collision, "known header names must hash to distinct slots");
+
+bool EqualsIgnoreCase(string_view a, string_view b) {
+    if(a.size() != b.size()) { return false; }
+    for(size_t i = 0; i < a.size(); i++) {
+        if(ToLower(a[i]) != ToLower(b[i])) { return false; }
+    }
+    return true;
+}
+
+} // namespace
+
+size_t HttpRequest::maxHeaderBytes = 8192;
+size_t HttpRequest::maxBodyBytes = 1024 * 1024;
 
 // 初始化请求对象信息
 void HttpRequest::Init() {
-    method_ = path_ = version_ = body_ = "";  // 定义的变量初始化为空
+    method_ = path_ = version_ = "";          // 定义的变量初始化为空
+    body_ = string_view();
     state_ = REQUEST_LINE;                    // 初始化请求状态：正在解析请求行
-    header_.clear();                          // 对应的哈希集合清零，下同
-    post_.clear();
+    headerCnt_ = 0;                           // 对应的请求头清零，下同
+    memset(known_, 0, sizeof(known_));
+    post_.emplace(arena_);
+    paramCnt_ = 0;
+    base_ = nullptr;
+    parsed_ = scanned_ = contentLen_ = 0;
+    bodyOff_ = bodyLen_ = chunkLeft_ = trailerOff_ = 0;
+    bodyHandler_ = nullptr;
+    isKeepAlive_ = false;
 }
 
 bool HttpRequest::IsKeepAlive() const {
-    if(header_.count("Connection") == 1) {
-        return header_.find("Connection")->second == "keep-alive" && version_ == "1.1";
+    return isKeepAlive_;
+}
+
+std::string_view HttpRequest::GetHeader(HEADER header) const {
+    assert(header >= 0 && header < HEADER_COUNT);
+    if(known_[header] == 0) { return std::string_view(); }
+    const HeaderField& field = header_[known_[header] - 1];
+    return std::string_view(base_ + field.valueOff, field.valueLen);
+}
+
+// 同名的请求头以最后一个为准
+std::string_view HttpRequest::GetHeader(std::string_view key) const {
+    for(int i = headerCnt_ - 1; i >= 0; i--) {
+        if(EqualsIgnoreCase(std::string_view(base_ + header_[i].keyOff, header_[i].keyLen), key)) {
+            return std::string_view(base_ + header_[i].valueOff, header_[i].valueLen);
+        }
     }
-    return false;
+    return std::string_view();
+}
+
+std::string_view HttpRequest::GetParam(std::string_view name) const {
+    for(int i = 0; i < paramCnt_; i++) {
+        if(params_[i].name == name) { return params_[i].value; }
+    }
+    return std::string_view();
 }
 
 // 解析请求数据，这个函数是解析报文的核心函数
 // 解析的过程涉及了有限状态机的转移
-bool HttpRequest::parse(Buffer& buff) {
-    const char CRLF[] = "\r\n"; // 行结束符
-    if(buff.ReadableBytes() <= 0) {
-        return false;
-    }
-    // buff中有数据可读，并且状态没有到FINISH，就一直解析
-    while(buff.ReadableBytes() && state_ != FINISH) {
-        // 获取一行数据，根据\r\n为结束标志
-        // lineEnd 为一行结束时的下一个
-        // 一行一行地解析
-        const char* lineEnd = search(buff.Peek(), buff.BeginWriteConst(), CRLF, CRLF + 2);
-        std::string line(buff.Peek(), lineEnd);     // 获取一行数据
+HttpRequest::HTTP_CODE HttpRequest::parse(Buffer& buff) {
+    // 上一个请求已经处理完，开始解析新的请求
+    if(state_ == FINISH) { Init(); }
+    // 请求完整之前数据一直留在缓冲区里，Peek()总是请求的开头
+    base_ = buff.Peek();
+    const char* end = buff.BeginWriteConst();
+    // 没有数据时什么也不用做，下面计算的长度都假设缓冲区不为空
+    if(end == base_) { return NO_REQUEST; }
+    while(state_ != FINISH) {
+        if(state_ == BODY) {
+            // 请求体按Content-Length接收完整后才解析
+            if(static_cast<size_t>(end - base_) - parsed_ < contentLen_) { return NO_REQUEST; }
+            std::string_view body(base_ + parsed_, contentLen_);
+            if(bodyHandler_) { (*bodyHandler_)(*this, body); }
+            ParseBody_(body);
+            parsed_ += contentLen_;
+            break;
+        }
+        if(state_ == CHUNK_DATA) {
+            // 块数据收到多少解码多少，不必等整块到达
+            size_t len = std::min(chunkLeft_, static_cast<size_t>(end - base_) - parsed_);
+            if(len == 0) { return NO_REQUEST; }
+            DecodeChunk_(len);
+            if(chunkLeft_ == 0) { state_ = CHUNK_END; }
+            continue;
+        }
+        // 获取一行数据，根据\r\n为结束标志，只查找上次没找过的部分('\r'可能是上次的最后一个字节)
+        const char* lineEnd = HttpScan::FindCRLF(base_ + std::max(parsed_, scanned_), end);
+        if(lineEnd == end) {
+            // 请求头(或块大小行、trailer)还没收完就已经超过上限，不再继续缓存
+            size_t received = static_cast<size_t>(end - base_);
+            size_t lineStart = (state_ == REQUEST_LINE || state_ == HEADERS ? 0:
+                                state_ == TRAILER ? trailerOff_: parsed_);
+            if(received - lineStart > maxHeaderBytes) { return HEADER_TOO_LARGE; }
+            if(state_ == CHUNK_SIZE || state_ == CHUNK_END) {
+                HTTP_CODE ret = CheckFraming_(received);
+                if(ret != NO_REQUEST) { return ret; }
+            }
+            // 行还不完整，不消耗数据，等待更多数据
+            scanned_ = std::max(parsed_, received - 1);
+            return NO_REQUEST;
+        }
+        std::string_view line(base_ + parsed_, lineEnd - base_ - parsed_);  // 获取一行数据，不拷贝
+        parsed_ = lineEnd + 2 - base_;
 
         switch(state_)
         {
         case REQUEST_LINE:
+            // 请求行之前的空行忽略(有的客户端在POST请求体后面多发一个CRLF)
+            if(line.empty()) { break; }
             // 解析请求首行
             if(!ParseRequestLine_(line)) {
-                return false;
+                return BAD_REQUEST;
             }
-            // 解析出请求资源路径
-            ParsePath_();
             break;    
         case HEADERS:
+            // 空行表示请求头结束，有请求体则继续接收请求体
+            if(line.empty()) {
+                if(parsed_ > maxHeaderBytes) { return HEADER_TOO_LARGE; }
+                HTTP_CODE ret = ParseFraming_();
+                if(ret != NO_REQUEST) { return ret; }
+            }
+            // 请求头个数超过上限
+            else if(headerCnt_ == MAX_HEADERS) {
+                return HEADER_TOO_LARGE;
+            }
             // 解析请求头
-            ParseHeader_(line);
-            if(buff.ReadableBytes() <= 2) {
-                state_ = FINISH;
+            else if(!ParseHeader_(line)) {
+                return BAD_REQUEST;
             }
             break;
-        case BODY:
-            // 解析请求体
-            ParseBody_(line);
+        case CHUNK_SIZE:
+            if(!ParseChunkSize_(line)) { return BAD_REQUEST; }
+            if(CheckFraming_(parsed_) != NO_REQUEST) { return ENTITY_TOO_LARGE; }
+            // 解码后的请求体超过上限时不等这一块到达，直接拒绝
+            if(chunkLeft_ > maxBodyBytes - bodyLen_) { return ENTITY_TOO_LARGE; }
+            // 大小为0的块是最后一块
+            state_ = (chunkLeft_ > 0 ? CHUNK_DATA: TRAILER);
+            trailerOff_ = parsed_;
+            break;
+        case CHUNK_END:
+            if(!line.empty()) {
+                LOG_ERROR("Chunk Error");
+                return BAD_REQUEST;
+            }
+            state_ = CHUNK_SIZE;
+            break;
+        case TRAILER:
+            // trailer中的字段不使用，空行表示请求结束；和请求头一样限制总字节数
+            if(line.empty()) {
+                ParseBody_(std::string_view(base_ + bodyOff_, bodyLen_));
+            }
+            else if(parsed_ - trailerOff_ > maxHeaderBytes) {
+                return HEADER_TOO_LARGE;
+            }
             break;
         default:
             break;
         }
-        // 判断数据读取完了，说明解析完了
-        if(lineEnd == buff.BeginWrite()) { break; }
-        // 读完一行，移动读指针
-        buff.RetrieveUntil(lineEnd + 2);
     }
+    isKeepAlive_ = (GetHeader(CONNECTION) == "keep-alive" && version_ == "1.1");
+    // 请求头和请求体都还在缓冲区中，交给路由决定访问的资源
+    Router::Instance()->Dispatch(*this);
+    // 取走这个请求，流水线中后面的请求留在缓冲区
+    buff.Retrieve(parsed_);
     LOG_DEBUG("[%s], [%s], [%s]", method_.c_str(), path_.c_str(), version_.c_str());
-    return true;
+    return GET_REQUEST;
 }
 
-// 解析请求路径
-void HttpRequest::ParsePath_() {
-    // 如果访问根目录，默认表示访问index.html
-    // 例如 http://192.168.110.111:10000/
-    if(path_ == "/") {
-        path_ = "/index.html"; 
-    }
-    else {
-        // 其他默认的一些页面
-        // 例如 http://192.168.110.111:10000/regist
-        for(auto &item: DEFAULT_HTML) {
-            if(item == path_) {
-                path_ += ".html";
-                break;
-            }
-        }
-    }
-}
 // 解析请求行
-bool HttpRequest::ParseRequestLine_(const string& line) {
+bool HttpRequest::ParseRequestLine_(string_view line) {
     // GET / HTTP/1.1
-    // 正则匹配
-    regex patten("^([^ ]*) ([^ ]*) HTTP/([^ ]*)$");
-    smatch subMatch;   // 传出参数
-    if(regex_match(line, subMatch, patten)) {   
-        // 解析成功，然后获取请求类型，路径，版本，然后进行状态转移
-        method_ = subMatch[1];
-        path_ = subMatch[2];
-        version_ = subMatch[3];
-        state_ = HEADERS;
-        return true;
+    // 格式为"方法 路径 HTTP/版本"，恰好两个空格分隔
+    size_t sp1 = line.find(' ');
+    size_t sp2 = (sp1 == string_view::npos ? sp1 : line.find(' ', sp1 + 1));
+    if(sp2 != string_view::npos) {
+        string_view proto = line.substr(sp2 + 1);
+        if(proto.compare(0, 5, "HTTP/") == 0 && proto.find(' ') == string_view::npos) {
+            // 解析成功，然后获取请求类型，路径，版本，然后进行状态转移
+            method_.assign(line.data(), sp1);
+            path_.assign(line.data() + sp1 + 1, sp2 - sp1 - 1);
+            version_.assign(proto.data() + 5, proto.size() - 5);
+            state_ = HEADERS;
+            return true;
+        }
     }
     LOG_ERROR("RequestLine Error");
     return false;
@@ -110,25 +238,132 @@ bool HttpRequest::ParseRequestLine_(const string& line) {
 // Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8,application/signed-exchange;v=b3;q=0.9
 // Connection: keep-alive
 // 解析请求头
-void HttpRequest::ParseHeader_(const string& line) {
-    regex patten("^([^:]*): ?(.*)$");
-    smatch subMatch;
-    if(regex_match(line, subMatch, patten)) {
-        // 匹配成功，将请求头的键和值放入unordered_map中
-        header_[subMatch[1]] = subMatch[2];
+bool HttpRequest::ParseHeader_(string_view line) {
+    // 格式为"键: 值"，冒号后最多跳过一个空格，值中不能再有换行符
+    size_t colon = line.find(':');
+    string_view value;
+    if(colon != string_view::npos) {
+        value = line.substr(colon + 1);
+        if(!value.empty() && value[0] == ' ') { value.remove_prefix(1); }
+    }
+    const char* valueEnd = value.data() + value.size();
+    if(colon != string_view::npos && HttpScan::FindEol(value.data(), valueEnd) == valueEnd) {
+        // 匹配成功，记录请求头的键和值相对请求开头的位置(请求头总长不超过maxHeaderBytes)
+        HeaderField& field = header_[headerCnt_++];
+        field.keyOff = static_cast<uint32_t>(line.data() - base_);
+        field.keyLen = static_cast<uint32_t>(colon);
+        field.valueOff = static_cast<uint32_t>(value.data() - base_);
+        field.valueLen = static_cast<uint32_t>(value.size());
+        // 常用请求头：按哈希找到唯一可能的名字，比较一次即可
+        if(colon > 0) {
+            int known = HEADER_SLOTS.header[HeaderSlot(line.data(), colon)];
+            if(known >= 0 && EqualsIgnoreCase(line.substr(0, colon), KNOWN_HEADER_NAME[known])) {
+                known_[known] = static_cast<uint8_t>(headerCnt_);
+            }
+        }
+        return true;
+    }
+    // 不是"键: 值"格式的请求头
+    LOG_ERROR("Header Error");
+    return false;
+}
+
+// 请求头结束后确定请求体怎样接收：Transfer-Encoding为chunked时逐块解码，否则按Content-Length接收；
+// 两者同时出现或者编码不是以chunked结尾时无法确定请求的边界，返回BAD_REQUEST；可以继续解析时返回NO_REQUEST
+HttpRequest::HTTP_CODE HttpRequest::ParseFraming_() {
+    string_view te = GetHeader(TRANSFER_ENCODING);
+    if(te.empty()) {
+        if(!ParseContentLength_()) { return BAD_REQUEST; }
+        // 请求体超过上限时不等它到达，直接拒绝
+        if(contentLen_ > maxBodyBytes) { return ENTITY_TOO_LARGE; }
+        state_ = (contentLen_ > 0 ? BODY: FINISH);
+        if(state_ == BODY) { bodyHandler_ = Router::Instance()->FindBodyHandler(*this); }
+        return NO_REQUEST;
+    }
+    // 编码可以是"gzip, chunked"这样的列表，chunked必须是最后一个
+    while(!te.empty() && (te.back() == ' ' || te.back() == '\t')) { te.remove_suffix(1); }
+    size_t comma = te.find_last_of(',');
+    string_view last = (comma == string_view::npos ? te: te.substr(comma + 1));
+    while(!last.empty() && (last.front() == ' ' || last.front() == '\t')) { last.remove_prefix(1); }
+    const char CHUNKED[] = "chunked";
+    bool isChunked = (last.size() == sizeof(CHUNKED) - 1);
+    for(size_t i = 0; isChunked && i < last.size(); i++) {
+        isChunked = (tolower(static_cast<unsigned char>(last[i])) == CHUNKED[i]);
     }
-    else {
-        // 若匹配不成功，说明请求头读取完，开始处理解析请求体
-        state_ = BODY;
+    if(!isChunked || known_[CONTENT_LENGTH] != 0) {
+        LOG_ERROR("Transfer-Encoding Error");
+        return BAD_REQUEST;
     }
+    bodyOff_ = parsed_;
+    bodyLen_ = 0;
+    state_ = CHUNK_SIZE;
+    bodyHandler_ = Router::Instance()->FindBodyHandler(*this);
+    return NO_REQUEST;
+}
+
+// 请求完整之前原始数据一直留在缓冲区里：除去请求头和解码后的请求体，块大小行(包括扩展)
+// 和块结尾的总字节数不能超过CHUNK_FRAMING_MAX，否则用大量的小块或很长的扩展就能让缓冲区无限增长
+// received为这个请求已经收到的原始字节数，超过时返回ENTITY_TOO_LARGE，否则返回NO_REQUEST
+HttpRequest::HTTP_CODE HttpRequest::CheckFraming_(size_t received) const {
+    if(received - bodyOff_ - bodyLen_ > CHUNK_FRAMING_MAX) {
+        LOG_ERROR("Chunk framing too large");
+        return ENTITY_TOO_LARGE;
+    }
+    return NO_REQUEST;
+}
+
+// 块大小行：十六进制的大小，后面可以跟";扩展"，扩展忽略
+bool HttpRequest::ParseChunkSize_(string_view line) {
+    chunkLeft_ = 0;
+    size_t i = 0;
+    for(; i < line.size(); i++) {
+        char ch = line[i];
+        size_t digit = 0;
+        if(ch >= '0' && ch <= '9') { digit = ch - '0'; }
+        else if(ch >= 'a' && ch <= 'f') { digit = ch - 'a' + 10; }
+        else if(ch >= 'A' && ch <= 'F') { digit = ch - 'A' + 10; }
+        else { break; }
+        if(chunkLeft_ > (SIZE_MAX >> 4)) { i = 0; break; }
+        chunkLeft_ = (chunkLeft_ << 4) | digit;
+    }
+    if(i == 0 || (i < line.size() && line[i] != ';' && line[i] != ' ' && line[i] != '\t')) {
+        LOG_ERROR("Chunk Size Error");
+        return false;
+    }
+    return true;
+}
+
+// 收到的len字节块数据前移到已解码的请求体后面，并交给请求体处理函数
+// 目标位置总在源数据之前，块的分隔行被覆盖掉，后面未解析的数据不受影响
+void HttpRequest::DecodeChunk_(size_t len) {
+    char* dst = base_ + bodyOff_ + bodyLen_;
+    memmove(dst, base_ + parsed_, len);
+    if(bodyHandler_) { (*bodyHandler_)(*this, string_view(dst, len)); }
+    bodyLen_ += len;
+    parsed_ += len;
+    chunkLeft_ -= len;
+}
+
+// 解析Content-Length，没有时请求体长度为0，不是十进制数时返回false
+bool HttpRequest::ParseContentLength_() {
+    string_view value = GetHeader(CONTENT_LENGTH);
+    contentLen_ = 0;
+    for(char ch: value) {
+        if(ch < '0' || ch > '9' || contentLen_ > (SIZE_MAX - 9) / 10) {
+            LOG_ERROR("Content-Length Error");
+            return false;
+        }
+        contentLen_ = contentLen_ * 10 + (ch - '0');
+    }
+    return true;
 }
 
 // 解析请求体
-void HttpRequest::ParseBody_(const string& line) {
-    body_ = line;  // 将数据保存至请求体
+void HttpRequest::ParseBody_(string_view line) {
+    body_ = line;  // 请求体直接指向读缓冲区
     ParsePost_();  // 解析post数据
     state_ = FINISH;  // 解析结束
-    LOG_DEBUG("Body:%s, len:%d", line.c_str(), line.size());
+    LOG_DEBUG("Body:%.*s, len:%d", (int)body_.size(), body_.data(), (int)body_.size());
 }
 
 // 将十六进制的字符，转换成十进制的整数
@@ -139,70 +374,54 @@ int HttpRequest::ConverHex(char ch) {
 }
 
 void HttpRequest::ParsePost_() {
-    // 这里只解析了单一的post请求
-    if(method_ == "POST" && header_["Content-Type"] == "application/x-www-form-urlencoded") {
+    // 这里只解析了单一的post请求，表单交给路由中的处理函数使用
+    if(method_ == "POST" && GetHeader(CONTENT_TYPE) == "application/x-www-form-urlencoded") {
         // 解析表单信息，解析出用户名和密码
         ParseFromUrlencoded_();
-        // 判断是否位于登录或者注册页面
-        if(DEFAULT_HTML_TAG.count(path_)) {
-            int tag = DEFAULT_HTML_TAG.find(path_)->second;
-            LOG_DEBUG("Tag:%d", tag);
-            if(tag == 0 || tag == 1) {
-                // 0为注册，1为登录
-                bool isLogin = (tag == 1);
-                // 验证是否登录成功，或者注册是否成功，UserVerify内部也实现了注册的功能
-                // 注册成功也会自动登录然后来到欢迎界面
-                if(UserVerify(post_["username"], post_["password"], isLogin)) {
-                    path_ = "/welcome.html";
-                } 
-                else {
-                    path_ = "/error.html";
-                }
-            }
-        }
     }   
 }
 
 void HttpRequest::ParseFromUrlencoded_() {
     if(body_.size() == 0) { return; }
     // username=zhangsan&password=123
-    string key, value;
+    // 请求体是读缓冲区的只读视图，边扫描边把转换后的字符放进token(当前的键或值)
+    pmr::string key(arena_), value(arena_), token(arena_);
     int num = 0;
     int n = body_.size();   // 整个请求体的大小
-    int i = 0, j = 0;
+    int i = 0;
     // 然后逐个字符去遍历，根据=、&号去分割信息
     for(; i < n; i++) {
         char ch = body_[i];
         switch (ch) {
         case '=':
-            key = body_.substr(j, i - j);
-            j = i + 1;
+            key = token;
+            token.clear();
             break;
         case '+':
-            body_[i] = ' ';
+            token += ' ';
             break;
         case '%':
-            // 简单的加密的操作，编码
-            num = ConverHex(body_[i + 1]) * 16 + ConverHex(body_[i + 2]);
-            body_[i + 2] = num % 10 + '0';
-            body_[i + 1] = num / 10 + '0';
+            // 简单的加密的操作，编码，"%"后不足两个字符时按0处理
+            num = ConverHex(i + 1 < n ? body_[i + 1] : '\0') * 16 + ConverHex(i + 2 < n ? body_[i + 2] : '\0');
+            token += '%';
+            token += static_cast<char>(num / 10 + '0');
+            token += static_cast<char>(num % 10 + '0');
             i += 2;
             break;
         case '&':
-            value = body_.substr(j, i - j);
-            j = i + 1;
-            post_[key] = value;
+            value = token;
+            token.clear();
+            (*post_)[key] = value;
             // 将键和值写入日志
             LOG_DEBUG("%s = %s", key.c_str(), value.c_str());
             break;
         default:
+            token += ch;
             break;
         }
     }
-    assert(j <= i);
-    if(post_.count(key) == 0 && j < i) {
-        value = body_.substr(j, i - j);
-        post_[key] = value;
+    if(post_->count(key) == 0 && !token.empty()) {
+        (*post_)[key] = token;
     }
 }
 
@@ -294,16 +513,18 @@ std::string HttpRequest::version() const {
 
 std::string HttpRequest::GetPost(const std::string& key) const {
     assert(key != "");
-    if(post_.count(key) == 1) {
-        return post_.find(key)->second;
+    auto it = post_->find(pmr::string(key, arena_));
+    if(it != post_->end()) {
+        return string(it->second);
     }
     return "";
 }
 
 std::string HttpRequest::GetPost(const char* key) const {
     assert(key != nullptr);
-    if(post_.count(key) == 1) {
-        return post_.find(key)->second;
+    auto it = post_->find(pmr::string(key, arena_));
+    if(it != post_->end()) {
+        return string(it->second);
     }
     return "";
 }
\ No newline at end of file
@@ -2,13 +2,18 @@
 #define HTTP_REQUEST_H
 
 #include <unordered_map>
-#include <unordered_set>
 #include <string>
-#include <regex>
+#include <string_view>
+#include <algorithm>
+#include <functional>
+#include <optional>
+#include <memory_resource>
+#include <stdint.h>   // SIZE_MAX
 #include <errno.h>     
 #include <mysql/mysql.h>  //mysql
 
 #include "../buffer/buffer.h"
+#include "httpscan.h"
 #include "../log/log.h"
 #include "../pool/sqlconnpool.h"
 #include "../pool/sqlconnRAII.h"
@@ -21,6 +26,10 @@ public:
         REQUEST_LINE,   // 正在解析请求首行
         HEADERS,        // 正在解析请求头
         BODY,           // 正在解析请求体
+        CHUNK_SIZE,     // chunked请求体：正在解析块大小行
+        CHUNK_DATA,     // chunked请求体：正在接收块数据
+        CHUNK_END,      // chunked请求体：块数据后的CRLF
+        TRAILER,        // chunked请求体：最后一块之后的trailer，到空行结束
         FINISH,         // 解析完成
     };
 
@@ -34,6 +43,8 @@ public:
         FILE_REQUEST,   文件请求，获取文件成功
         INTERNAL_ERROR, 表示服务器内部错误
         CLOSED_CONNECTION,  表示客户端已经关闭连接了
+        ENTITY_TOO_LARGE,   请求体超过maxBodyBytes(413)
+        HEADER_TOO_LARGE,   请求行加请求头超过maxHeaderBytes(431)
         */
         NO_REQUEST = 0,
         GET_REQUEST,
@@ -43,13 +54,37 @@ public:
         FILE_REQUEST,
         INTERNAL_ERROR,
         CLOSED_CONNECTION,
+        ENTITY_TOO_LARGE,
+        HEADER_TOO_LARGE,
     };
+    // 常用的请求头，解析时记录下位置，按编号直接取值
+    enum HEADER {
+        CONNECTION = 0,
+        CONTENT_LENGTH,
+        CONTENT_TYPE,
+        HOST,
+        TRANSFER_ENCODING,
+        ACCEPT_ENCODING,
+        IF_NONE_MATCH,
+        IF_MODIFIED_SINCE,
+        RANGE,
+        IF_RANGE,
+        HEADER_COUNT,
+    };
+
     // 构造函数执行初始化操作
-    HttpRequest() { Init(); }
+    HttpRequest() : arena_(std::pmr::new_delete_resource()) { Init(); }
     ~HttpRequest() = default;
 
+    // 请求处理完后调用，释放这个请求在内存区中的数据，之后内存区才能回收
     void Init();
-    bool parse(Buffer& buff);
+    // 表单等临时数据从arena中分配，默认直接用new/delete
+    void SetArena(std::pmr::memory_resource* arena) { arena_ = arena; Init(); }
+    // 解析buff中的请求，可以跨多次read继续：数据不完整时返回NO_REQUEST且不消耗数据，
+    // 下次从上次停下的位置继续；完整时返回GET_REQUEST并从buff中取走这个请求，
+    // 后面流水线发来的请求留在buff中；格式错误返回BAD_REQUEST，
+    // 请求头或Content-Length超过上限时不等数据收完，立即返回HEADER_TOO_LARGE/ENTITY_TOO_LARGE
+    HTTP_CODE parse(Buffer& buff);
 
     std::string path() const;
     std::string& path();
@@ -60,26 +95,80 @@ public:
 
     bool IsKeepAlive() const;
 
-private:
-    
-    bool ParseRequestLine_(const std::string& line);    // 解析请求行
-    void ParseHeader_(const std::string& line);         // 解析请求头
-    void ParseBody_(const std::string& line);           // 解析请求体（请求数据）
+    // 请求体，指向读缓冲区中的数据，下一次读之前有效
+    std::string_view body() const { return body_; }
 
-    void ParsePath_();              // 解析请求的路径
-    void ParsePost_();              // 解析post请求？
-    void ParseFromUrlencoded_();    // 解析表单数据
+    // 请求头的值，不存在时为空；同名的请求头以最后一个为准，名字不区分大小写
+    // 和请求体一样指向读缓冲区，下一次读或解析下一个请求之前有效
+    std::string_view GetHeader(HEADER header) const;
+    std::string_view GetHeader(std::string_view key) const;  // 不在HEADER中的请求头，逐个比较
+
+    // 请求体处理函数，通过Router::AddRoute和路由一起注册，请求头解析完后按方法和路径选定
+    // chunked请求体每解码出一段就调用一次，Content-Length请求体收完整后调用一次
+    typedef std::function<void(HttpRequest&, std::string_view)> BodyHandler;
+
+    // 路由中":name"或"*name"匹配到的路径参数，不存在时为空；指向path()，路径被改写之前有效
+    std::string_view GetParam(std::string_view name) const;
 
     // 验证用户注册登录
     static bool UserVerify(const std::string& name, const std::string& pwd, bool isLogin);
 
+    static size_t maxHeaderBytes;   // 请求行加请求头的最大字节数
+    static size_t maxBodyBytes;     // 请求体的最大字节数
+
+private:
+    friend class Router;    // 分发时填写路径参数，选定请求体处理函数
+    
+    bool ParseRequestLine_(std::string_view line);      // 解析请求行
+    bool ParseHeader_(std::string_view line);           // 解析请求头
+    bool ParseContentLength_();                         // 解析Content-Length，得到请求体长度
+    HTTP_CODE ParseFraming_();                          // 请求头结束后确定请求体的格式和长度
+    bool ParseChunkSize_(std::string_view line);        // 解析chunked的块大小行
+    void DecodeChunk_(size_t len);                      // 把块数据前移到已解码的请求体后面
+    HTTP_CODE CheckFraming_(size_t received) const;     // chunked请求的分隔数据是否超过上限
+    void ParseBody_(std::string_view line);             // 解析请求体（请求数据）
+
+    void ParsePost_();              // 解析post请求的表单
+    void ParseFromUrlencoded_();    // 解析表单数据
+
     PARSE_STATE state_;     // 解析的状态
-    std::string method_, path_, version_, body_;    // 请求方法，请求路径，协议版本，请求体
-    std::unordered_map<std::string, std::string> header_;   // 请求头
-    std::unordered_map<std::string, std::string> post_;     // post请求表单数据
+    std::string method_, path_, version_;   // 请求方法，请求路径，协议版本
+    std::string_view body_;     // 请求体，不拷贝
+    // 请求头在读缓冲区中的位置，以请求开头为基准：请求完整之前不会从缓冲区取走，
+    // 缓冲区扩容或数据前移后偏移量仍然有效；只在parse期间使用
+    struct HeaderField {
+        uint32_t keyOff, keyLen;
+        uint32_t valueOff, valueLen;
+    };
+    static const int MAX_HEADERS = 64;  // 请求头个数的上限，超过时返回431
+    // 请求头直接存放在对象内的数组里，解析时不分配内存
+    HeaderField header_[MAX_HEADERS];
+    int headerCnt_;
+    // 常用请求头在header_中的下标加1，0表示没有
+    uint8_t known_[HEADER_COUNT];
+    char* base_;            // 本次parse时请求开头在缓冲区中的地址
+    size_t parsed_;         // 已解析完的字节数(完整的行)，下次从这里继续
+    size_t scanned_;        // 已经找过行结束符的字节数，不完整的行不必从头再找
+    size_t contentLen_;     // 请求体长度
+    // chunked请求体在缓冲区中原地解码：块数据依次前移，紧接在请求头之后拼成连续的请求体
+    size_t bodyOff_;        // 解码后的请求体相对请求开头的位置
+    size_t bodyLen_;        // 已解码的长度
+    size_t chunkLeft_;      // 当前块还没收到的字节数
+    size_t trailerOff_;     // trailer相对请求开头的位置，trailer总长不超过maxHeaderBytes
+    static const size_t CHUNK_FRAMING_MAX = 64 * 1024;  // chunked请求中块大小行和块结尾总共允许的字节数
+    const BodyHandler* bodyHandler_;    // 指向路由中注册的处理函数，没有时为nullptr
+    bool isKeepAlive_;      // 解析时根据Connection头和协议版本算出，请求头失效后仍可使用
+    std::pmr::memory_resource* arena_;  // 请求期间的临时数据在这里分配
+    typedef std::pmr::unordered_map<std::pmr::string, std::pmr::string> PostMap;
+    // post请求表单数据，每个请求重新构造在当前的内存区上
+    std::optional<PostMap> post_;
+    static const int MAX_PARAMS = 8;    // 一条路由中参数个数的上限
+    struct Param {
+        std::string_view name, value;
+    };
+    Param params_[MAX_PARAMS];
+    int paramCnt_;
 
-    static const std::unordered_set<std::string> DEFAULT_HTML;  // 默认的网页
-    static const std::unordered_map<std::string, int> DEFAULT_HTML_TAG; 
     static int ConverHex(char ch);  // 将十六进制字符转换成十进制整数
 };
 
@@ -28,9 +28,14 @@ const unordered_map<string, string> HttpResponse::SUFFIX_TYPE = {
 // 响应状态码对应的描述语
 const unordered_map<int, string> HttpResponse::CODE_STATUS = {
     { 200, "OK" },
+    { 206, "Partial Content" },
+    { 304, "Not Modified" },
     { 400, "Bad Request" },
     { 403, "Forbidden" },
     { 404, "Not Found" },
+    { 413, "Payload Too Large" },
+    { 416, "Range Not Satisfiable" },
+    { 431, "Request Header Fields Too Large" },
 };
 
 // 响应码对应的资源路径
@@ -40,162 +45,492 @@ const unordered_map<int, string> HttpResponse::CODE_PATH = {
     { 404, "/404.html" },
 };
 
+// 状态行和Connection头只依赖状态码和是否保持连接，启动时拼接好，每个响应直接复制
+const unordered_map<int, array<string, 2>> HttpResponse::STATUS_HEAD = [] {
+    unordered_map<int, array<string, 2>> heads;
+    for(const auto& [code, status]: CODE_STATUS) {
+        string line = "HTTP/1.1 " + to_string(code) + " " + status + "\r\n";
+        heads[code] = { line + "Connection: close\r\n",
+                        line + "Connection: keep-alive\r\nkeep-alive: max=6, timeout=120\r\n" };
+    }
+    return heads;
+}();
+
+unordered_map<int, HttpResponse::CannedPtr> HttpResponse::cannedResp_;
+string HttpResponse::errorDir_;
+
 // 构造函数
 HttpResponse::HttpResponse() {
     code_ = -1;             // 响应状态码
     path_ = srcDir_ = "";   // 资源路径和资源目录
     isKeepAlive_ = false;   // 默认不保持连接
-    mmFile_ = nullptr;      // 文件内存映射的指针
-    mmFileStat_ = { 0 };    // 文件的状态信息
+    rangeCnt_ = 0;
+    arena_ = pmr::new_delete_resource();
 };
 
 HttpResponse::~HttpResponse() {
     UnmapFile();
 }
 
-void HttpResponse::Init(const string& srcDir, string& path, bool isKeepAlive, int code){
-    assert(srcDir != "");
+void HttpResponse::Init(string_view srcDir, string& path, bool isKeepAlive, int code){
+    assert(!srcDir.empty());
     
-    if(mmFile_) { UnmapFile(); }
+    UnmapFile();
 
     code_ = code;
     isKeepAlive_ = isKeepAlive;
     path_ = path;
-    srcDir_ = srcDir;
-    mmFile_ = nullptr; 
-    mmFileStat_ = { 0 };
+    srcDir_ = srcDir;   // 复制进已有的空间，不构造临时的string
+    ifNoneMatch_ = ifModifiedSince_ = range_ = ifRange_ = acceptEncoding_ = {};
+}
+
+void HttpResponse::SetConditional(string_view ifNoneMatch, string_view ifModifiedSince) {
+    ifNoneMatch_ = ifNoneMatch;
+    ifModifiedSince_ = ifModifiedSince;
+}
+
+void HttpResponse::SetRange(string_view range, string_view ifRange) {
+    range_ = range;
+    ifRange_ = ifRange;
 }
+
 // 将需要响应的数据信息写入buff
 void HttpResponse::MakeResponse(Buffer& buff) {
     /* 判断请求的资源文件 */
     // index.html
     // /home/nowcoder/WebServer-master/resources/ + index.html
-    // 获取状态信息，失败返回小于1，或者判断是否一个目录
-    if(stat((srcDir_ + path_).data(), &mmFileStat_) < 0 || S_ISDIR(mmFileStat_.st_mode)) {
-        code_ = 404;
+    // 从文件缓存中取，不存在或者是一个目录时为空
+    // 已经确定是错误响应(如400、413)时不再检查请求的文件，免得错误码被404覆盖或者把文件当作错误页面发出去
+    if(code_ == -1 || code_ == 200) {
+        // 完整路径只拼接一次，放在内存区中
+        if(!(file_ = FileCache::Instance()->Get(FilePath_()))) {
+            code_ = 404;
+        }
+        else if(!(file_->st.st_mode & S_IROTH)) {
+            // 没有权限
+            code_ = 403;
+        }
+        else {
+            // 协商编码：客户端接受gzip的文本文件换成压缩版本，之后的校验值和Range都按压缩版本
+            if(AcceptsGzip_() && IsCompressible_(file_->path)) {
+                if(FileCache::FilePtr gzip = FileCache::Instance()->GetGzip(file_)) {
+                    file_ = move(gzip);
+                }
+            }
+            // 客户端缓存的还是最新的，只回校验值，不发正文；否则没有Range时为200，有时为206或416
+            code_ = NotModified_() ? 304: ParseRange_();
+        }
+    }
+    if(code_ == 304) {
+        buff.Append(STATUS_HEAD.find(code_)->second[isKeepAlive_]);
+        buff.Append("ETag: ");
+        buff.Append(file_->etag);
+        buff.Append("\r\n");
+        if(IsCompressible_(file_->path)) {
+            buff.Append("Vary: Accept-Encoding\r\n");
+        }
+        buff.Append("\r\n");
+        file_.reset();
+        return;
+    }
+    if(code_ == 416) {
+        // 请求的范围都超出了文件，告诉客户端文件的大小
+        buff.Append(STATUS_HEAD.find(code_)->second[isKeepAlive_]);
+        buff.Append("Content-Range: bytes */");
+        AppendNum_(buff, file_->st.st_size);
+        buff.Append("\r\nContent-length: 0\r\n\r\n");
+        file_.reset();
+        return;
+    }
+    // 错误响应整个是预先生成的，不写进buff，和文件内容一样直接从这里发送
+    canned_ = GetCanned_(code_);
+    if(code_ != 200 && code_ != 206 && !canned_) {
+        code_ = 400;
+        canned_ = GetCanned_(code_);
+    }
+    if(canned_) {
+        file_.reset();
+        const string& resp = canned_->resp[isKeepAlive_];
+        body_.push_back({ resp.data(), 0, resp.size() });
+        return;
+    }
+    LOG_DEBUG("file path %s", file_->path.c_str());
+    // 状态行和Connection头
+    buff.Append(STATUS_HEAD.find(code_)->second[isKeepAlive_]);
+    // 校验值和Content-type，加载文件时已经生成
+    string fallback;
+    string_view header = file_->header;
+    if(header.empty()) {
+        fallback = FileHeader(*file_);
+        header = fallback;
     }
-    else if(!(mmFileStat_.st_mode & S_IROTH)) {
-        // 没有权限
-        code_ = 403;
+    // 正文并没有封装进buff，正文部分是请求的文件，在文件缓存中，地址存在file_里
+    size_t size = file_->st.st_size;
+    if(code_ == 200) {
+        buff.Append(header);
+        buff.Append("Content-length: ");
+        AppendNum_(buff, size);
+        buff.Append("\r\n\r\n");
+        AddBody_(0, size);
     }
-    else if(code_ == -1) { 
-        // 默认是-1
-        code_ = 200; 
+    else if(rangeCnt_ == 1) {
+        size_t first = ranges_[0].first, last = ranges_[0].second;
+        buff.Append(header);
+        buff.Append("Content-Range: bytes ");
+        AppendNum_(buff, first);
+        buff.Append("-");
+        AppendNum_(buff, last);
+        buff.Append("/");
+        AppendNum_(buff, size);
+        buff.Append("\r\nContent-length: ");
+        AppendNum_(buff, last - first + 1);
+        buff.Append("\r\n\r\n");
+        AddBody_(first, last - first + 1);
     }
-    // 寻找错误的文件
-    ErrorHtml_();
-    AddStateLine_(buff);        // 添加状态行
-    AddHeader_(buff);           // 添加响应头
-    AddContent_(buff);          // 添加响应体
+    else {
+        AddMultipart_(buff, header);
+    }
+}
+
+// 文件中的一段加入正文：在内存中的直接引用，只有fd的大文件记下偏移，由sendfile发送
+void HttpResponse::AddBody_(size_t offset, size_t len) {
+    if(len == 0) { return; }
+    if(file_->data) {
+        body_.push_back({ file_->data + offset, 0, len });
+    } else {
+        body_.push_back({ nullptr, static_cast<off_t>(offset), len });
+    }
+}
+
+// 多段Range：multipart/byteranges，各段的分隔行和段头写进parts_，文件内容仍然直接引用
+void HttpResponse::AddMultipart_(Buffer& buff, string_view header) {
+    // 文件的响应头以Content-type结尾，拆成前面的校验值和各段用的文件类型
+    size_t typePos = header.rfind("Content-type: ");
+    string_view type = header.substr(typePos + 14);
+    type.remove_suffix(2);
+    size_t size = file_->st.st_size;
+
+    // 先把各段的段头全部写完，parts_的地址不再变化后再加入正文
+    parts_.clear();
+    size_t partEnd[MAX_RANGES];
+    size_t total = 0;
+    for(int i = 0; i < rangeCnt_; i++) {
+        parts_.append("\r\n--").append(BOUNDARY);
+        parts_.append("\r\nContent-type: ").append(type);
+        parts_.append("\r\nContent-Range: bytes ");
+        AppendNum_(parts_, ranges_[i].first);
+        parts_ += '-';
+        AppendNum_(parts_, ranges_[i].second);
+        parts_ += '/';
+        AppendNum_(parts_, size);
+        parts_.append("\r\n\r\n");
+        partEnd[i] = parts_.size();
+        total += ranges_[i].second - ranges_[i].first + 1;
+    }
+    parts_.append("\r\n--").append(BOUNDARY).append("--\r\n");
+    total += parts_.size();
+
+    buff.Append(header.substr(0, typePos));
+    buff.Append("Content-type: multipart/byteranges; boundary=");
+    buff.Append(BOUNDARY);
+    buff.Append("\r\nContent-length: ");
+    AppendNum_(buff, total);
+    buff.Append("\r\n\r\n");
+
+    size_t begin = 0;
+    for(int i = 0; i < rangeCnt_; i++) {
+        body_.push_back({ parts_.data() + begin, 0, partEnd[i] - begin });
+        AddBody_(ranges_[i].first, ranges_[i].second - ranges_[i].first + 1);
+        begin = partEnd[i];
+    }
+    body_.push_back({ parts_.data() + begin, 0, parts_.size() - begin });
+}
+
+int HttpResponse::FileFd() const {
+    return file_ ? file_->fd: -1;
 }
 
-char* HttpResponse::File() {
-    return mmFile_;
+pmr::string HttpResponse::FilePath_() const {
+    pmr::string file(arena_);
+    file.reserve(srcDir_.size() + path_.size());
+    file.append(srcDir_).append(path_);
+    return file;
 }
 
-size_t HttpResponse::FileLen() const {
-    return mmFileStat_.st_size;
+void HttpResponse::AppendNum_(Buffer& buff, size_t num) {
+    char str[24];
+    char* end = to_chars(str, str + sizeof(str), num).ptr;
+    buff.Append(str, end - str);
 }
 
-void HttpResponse::ErrorHtml_() {
-    if(CODE_PATH.count(code_) == 1) {
-        path_ = CODE_PATH.find(code_)->second;
-        stat((srcDir_ + path_).data(), &mmFileStat_);
+void HttpResponse::AppendNum_(string& str, size_t num) {
+    char num_str[24];
+    char* end = to_chars(num_str, num_str + sizeof(num_str), num).ptr;
+    str.append(num_str, end - num_str);
+}
+
+// If-None-Match优先，没有时才看If-Modified-Since；If-None-Match用弱比较，忽略W/前缀
+bool HttpResponse::NotModified_() const {
+    if(!ifNoneMatch_.empty()) {
+        string_view list = ifNoneMatch_;
+        while(!list.empty()) {
+            size_t comma = list.find(',');
+            string_view tag = list.substr(0, comma);
+            list = (comma == string_view::npos) ? string_view(): list.substr(comma + 1);
+            while(!tag.empty() && (tag.front() == ' ' || tag.front() == '\t')) { tag.remove_prefix(1); }
+            while(!tag.empty() && (tag.back() == ' ' || tag.back() == '\t')) { tag.remove_suffix(1); }
+            if(tag.substr(0, 2) == "W/") { tag.remove_prefix(2); }
+            if(tag == "*" || tag == file_->etag) { return true; }
+        }
+        return false;
     }
+    if(!ifModifiedSince_.empty()) {
+        time_t since;
+        return ParseDate_(ifModifiedSince_, &since) && file_->st.st_mtime <= since;
+    }
+    return false;
 }
 
-// 添加响应状态行
-void HttpResponse::AddStateLine_(Buffer& buff) {
-    string status;
-    if(CODE_STATUS.count(code_) == 1) {
-        status = CODE_STATUS.find(code_)->second;
+// Accept-Encoding中有gzip(或x-gzip)且q不为0时接受；没有明确写gzip时看*
+bool HttpResponse::AcceptsGzip_() const {
+    string_view list = acceptEncoding_;
+    int gzip = -1, any = -1;    // -1为没有出现，0为q=0，1为接受
+    while(!list.empty()) {
+        size_t comma = list.find(',');
+        string_view item = list.substr(0, comma);
+        list = (comma == string_view::npos) ? string_view(): list.substr(comma + 1);
+        size_t semi = item.find(';');
+        string_view coding = item.substr(0, semi);
+        while(!coding.empty() && (coding.front() == ' ' || coding.front() == '\t')) { coding.remove_prefix(1); }
+        while(!coding.empty() && (coding.back() == ' ' || coding.back() == '\t')) { coding.remove_suffix(1); }
+        // q=0、q=0.0、q=0.000表示不接受
+        int accept = 1;
+        if(semi != string_view::npos) {
+            string_view params = item.substr(semi + 1);
+            size_t q = params.find("q=");
+            if(q != string_view::npos) {
+                string_view value = params.substr(q + 2);
+                size_t i = 0;
+                while(i < value.size() && (value[i] == '0' || value[i] == '.')) { i++; }
+                if(i > 0 && (i == value.size() || value[i] == ' ' || value[i] == '\t' || value[i] == ';')) {
+                    accept = 0;
+                }
+            }
+        }
+        if(coding.size() == 4 && strncasecmp(coding.data(), "gzip", 4) == 0) { gzip = accept; }
+        else if(coding.size() == 6 && strncasecmp(coding.data(), "x-gzip", 6) == 0) { gzip = accept; }
+        else if(coding == "*") { any = accept; }
     }
-    else {
-        code_ = 400;
-        status = CODE_STATUS.find(400)->second;
+    return gzip == 1 || (gzip == -1 && any == 1);
+}
+
+bool HttpResponse::IsCompressible_(string_view path) {
+    static const string_view SUFFIXES[] = {
+        ".html", ".htm", ".css", ".js", ".xml", ".xhtml", ".txt", ".rtf", ".svg", ".json",
+    };
+    size_t idx = path.find_last_of('.');
+    if(idx == string_view::npos) { return false; }
+    string_view suffix = path.substr(idx);
+    for(string_view s: SUFFIXES) {
+        if(suffix == s) { return true; }
     }
-    // to_string将整形转化成字符串类型
-    buff.Append("HTTP/1.1 " + to_string(code_) + " " + status + "\r\n");
+    return false;
 }
 
-// 添加响应头
-void HttpResponse::AddHeader_(Buffer& buff) {
-    buff.Append("Connection: ");
-    // 根据响应报文格式组织报文
-    if(isKeepAlive_) {
-        buff.Append("keep-alive\r\n");
-        buff.Append("keep-alive: max=6, timeout=120\r\n");
-    } else{
-        buff.Append("close\r\n");
+// 只认IMF-fixdate格式，如 Sun, 06 Nov 1994 08:49:37 GMT，其他格式当作没有这个请求头
+bool HttpResponse::ParseDate_(string_view str, time_t* t) {
+    char date[64];
+    if(str.size() >= sizeof(date)) { return false; }
+    memcpy(date, str.data(), str.size());
+    date[str.size()] = '\0';
+    struct tm tm = {};
+    const char* end = strptime(date, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if(end == nullptr || *end != '\0') { return false; }
+    *t = timegm(&tm);
+    return true;
+}
+
+// 整个字符串都是十进制数字时才成功
+bool HttpResponse::ParseNum_(string_view str, size_t* num) {
+    if(str.empty()) { return false; }
+    auto [end, ec] = from_chars(str.data(), str.data() + str.size(), *num);
+    return ec == errc() && end == str.data() + str.size();
+}
+
+// If-Range是ETag时要求强比较完全相同，是日期时要求和Last-Modified相同，不满足时发送整个文件
+bool HttpResponse::IfRangeMatch_() const {
+    if(ifRange_.empty()) { return true; }
+    if(ifRange_.front() == '"') { return ifRange_ == file_->etag; }
+    time_t date;
+    return ParseDate_(ifRange_, &date) && date == file_->st.st_mtime;
+}
+
+// 解析Range，返回200(没有Range、格式不对、段数太多或If-Range不满足时发送整个文件)、
+// 206(可以满足的段排序合并后存进ranges_)或416(格式正确但没有一段在文件范围内)
+int HttpResponse::ParseRange_() {
+    rangeCnt_ = 0;
+    if(range_.size() < 6 || strncasecmp(range_.data(), "bytes=", 6) != 0 || !IfRangeMatch_()) {
+        return 200;
     }
-    // GetFileType_() 用于获取文件类型
-    buff.Append("Content-type: " + GetFileType_() + "\r\n");
+    size_t size = file_->st.st_size;
+    string_view list = range_.substr(6);
+    int specCnt = 0;
+    while(!list.empty()) {
+        size_t comma = list.find(',');
+        string_view spec = list.substr(0, comma);
+        list = (comma == string_view::npos) ? string_view(): list.substr(comma + 1);
+        while(!spec.empty() && (spec.front() == ' ' || spec.front() == '\t')) { spec.remove_prefix(1); }
+        while(!spec.empty() && (spec.back() == ' ' || spec.back() == '\t')) { spec.remove_suffix(1); }
+        if(spec.empty()) { continue; }
+        // 段数有上限，避免用大量的小段放大响应
+        if(++specCnt > MAX_RANGES) { return 200; }
+        size_t dash = spec.find('-');
+        if(dash == string_view::npos) { return 200; }
+        size_t first, last;
+        if(dash == 0) {
+            // -n：最后n个字节
+            if(!ParseNum_(spec.substr(1), &last)) { return 200; }
+            if(last == 0 || size == 0) { continue; }
+            first = last >= size ? 0: size - last;
+            last = size - 1;
+        } else {
+            // a-b 或 a-：b超出文件时到文件末尾为止
+            if(!ParseNum_(spec.substr(0, dash), &first)) { return 200; }
+            if(dash + 1 == spec.size()) {
+                last = SIZE_MAX;
+            } else if(!ParseNum_(spec.substr(dash + 1), &last) || last < first) {
+                return 200;
+            }
+            if(first >= size) { continue; }
+            last = min(last, size - 1);
+        }
+        ranges_[rangeCnt_++] = { first, last };
+    }
+    if(specCnt == 0) { return 200; }
+    if(rangeCnt_ == 0) { return 416; }
+    // 重叠或相邻的段合并成一段
+    sort(ranges_, ranges_ + rangeCnt_);
+    int merged = 0;
+    for(int i = 1; i < rangeCnt_; i++) {
+        if(ranges_[i].first <= ranges_[merged].second + 1) {
+            ranges_[merged].second = max(ranges_[merged].second, ranges_[i].second);
+        } else {
+            ranges_[++merged] = ranges_[i];
+        }
+    }
+    rangeCnt_ = merged + 1;
+    return 206;
 }
 
-// 添加响应体
-void HttpResponse::AddContent_(Buffer& buff) {
-    // 打开请求的资源文件
-    int srcFd = open((srcDir_ + path_).data(), O_RDONLY);
-    if(srcFd < 0) { 
-        // 如果找不到这个文件
-        ErrorContent(buff, "File NotFound!");
-        return; 
+// Content-type放在最后，多段Range响应从这里拆出文件类型；Content-length每个响应自己加
+string HttpResponse::FileHeader(const FileCache::File& file) {
+    Buffer buff(256);
+    buff.Append("Accept-Ranges: bytes\r\n");
+    buff.Append("ETag: ");
+    buff.Append(file.etag);
+    buff.Append("\r\n");
+    // Last-Modified精确到秒，If-Modified-Since和它比较
+    char date[64];
+    struct tm tm;
+    gmtime_r(&file.st.st_mtime, &tm);
+    size_t dateLen = strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    buff.Append("Last-Modified: ");
+    buff.Append(date, dateLen);
+    buff.Append("\r\n");
+    // 文本文件按Accept-Encoding选择版本，中间的缓存要区分开
+    if(IsCompressible_(file.path)) {
+        buff.Append("Vary: Accept-Encoding\r\n");
+    }
+    if(file.encoding) {
+        buff.Append("Content-Encoding: ");
+        buff.Append(file.encoding);
+        buff.Append("\r\n");
     }
+    // GetFileType_() 用于获取文件类型
+    buff.Append("Content-type: ");
+    buff.Append(GetFileType_(file.path));
+    buff.Append("\r\n");
+    return buff.RetrieveAllToStr();
+}
 
-    /* 将文件映射到内存提高文件的访问速度 
-        MAP_PRIVATE 建立一个写入时拷贝的私有映射*/
-    LOG_DEBUG("file path %s", (srcDir_ + path_).data());
-    int* mmRet = (int*)mmap(0, mmFileStat_.st_size, PROT_READ, MAP_PRIVATE, srcFd, 0);
+// 有错误页面的错误码用页面作为正文，页面不存在或者没有页面的错误码生成简单的错误页面
+void HttpResponse::LoadErrorPages(string_view srcDir) {
+    errorDir_ = srcDir;
+    cannedResp_.clear();
+    for(const auto& [code, status]: CODE_STATUS) {
+        // 416要带上文件的大小，不能预先生成
+        if(code < 400 || code == 416) { continue; }
+        cannedResp_[code] = MakeCanned_(code);
+    }
+}
 
-    if(*mmRet == -1) {
-        // 映射失败
-        ErrorContent(buff, "File NotFound!");
-        return; 
+// 页面不存在时用生成的内容，这时没有缓存条目可以跟踪，之后不会再去找这个页面
+HttpResponse::CannedPtr HttpResponse::MakeCanned_(int code) {
+    auto canned = make_shared<Canned>();
+    string body;
+    auto path = CODE_PATH.find(code);
+    if(path != CODE_PATH.end()) {
+        canned->page = FileCache::Instance()->Get(errorDir_ + path->second);
+        if(canned->page && canned->page->data) {
+            body.assign(canned->page->data, canned->page->st.st_size);
+        } else {
+            body = ErrorContent_(code, "File NotFound!");
+        }
+    } else {
+        body = ErrorContent_(code, CODE_STATUS.find(code)->second);
     }
-    mmFile_ = (char*)mmRet;
-    close(srcFd);
-    // 告诉浏览器响应数据的大小，其实就是文件的大小：mmFileStat_.st_size
-    buff.Append("Content-length: " + to_string(mmFileStat_.st_size) + "\r\n\r\n");
+    string tail = "Content-type: text/html\r\nContent-length: " + to_string(body.size()) + "\r\n\r\n" + body;
+    const array<string, 2>& head = STATUS_HEAD.find(code)->second;
+    canned->resp = { head[0] + tail, head[1] + tail };
+    return canned;
+}
 
-    // 另外响应正文并没有封装进buff，正文部分是请求的文件，已经通过内存映射将内存地址存进mmFile_了
+// 页面的缓存条目失效后重新生成，多个线程同时发现时各自生成，留下最后一个
+HttpResponse::CannedPtr HttpResponse::GetCanned_(int code) {
+    auto it = cannedResp_.find(code);
+    if(it == cannedResp_.end()) { return nullptr; }
+    CannedPtr canned = atomic_load(&it->second);
+    if(canned->page && canned->page->IsStale()) {
+        LOG_INFO("Reload error page %d", code);
+        canned = MakeCanned_(code);
+        atomic_store(&it->second, canned);
+    }
+    return canned;
 }
 
-// 解除内存映射
+// 放开文件，缓存中的条目仍然保留；已经被淘汰的文件在最后一个引用放开时才解除映射
 void HttpResponse::UnmapFile() {
-    if(mmFile_) {
-        munmap(mmFile_, mmFileStat_.st_size);
-        mmFile_ = nullptr;
-    }
+    file_.reset();
+    canned_.reset();
+    body_.clear();
 }
 
-string HttpResponse::GetFileType_() {
+const string& HttpResponse::GetFileType_(string_view path) {
+    static const string TEXT_PLAIN = "text/plain";
     /* 判断文件类型 */
-    string::size_type idx = path_.find_last_of('.');
-    if(idx == string::npos) {
-        return "text/plain";
+    string_view::size_type idx = path.find_last_of('.');
+    if(idx == string_view::npos) {
+        return TEXT_PLAIN;
     }
-    string suffix = path_.substr(idx);
-    if(SUFFIX_TYPE.count(suffix) == 1) {
-        return SUFFIX_TYPE.find(suffix)->second;
+    auto it = SUFFIX_TYPE.find(string(path.substr(idx)));
+    if(it != SUFFIX_TYPE.end()) {
+        return it->second;
     }
-    return "text/plain";
+    return TEXT_PLAIN;
 }
 
-void HttpResponse::ErrorContent(Buffer& buff, string message) 
+string HttpResponse::ErrorContent_(int code, string_view message) 
 {
     string body;
-    string status;
+    string_view status = "Bad Request";
+    auto it = CODE_STATUS.find(code);
+    if(it != CODE_STATUS.end()) {
+        status = it->second;
+    }
     body += "<html><title>Error</title>";
     body += "<body bgcolor=\"ffffff\">";
-    if(CODE_STATUS.count(code_) == 1) {
-        status = CODE_STATUS.find(code_)->second;
-    } else {
-        status = "Bad Request";
-    }
-    body += to_string(code_) + " : " + status  + "\n";
-    body += "<p>" + message + "</p>";
+    body.append(to_string(code)).append(" : ").append(status).append("\n");
+    body.append("<p>").append(message).append("</p>");
     body += "<hr><em>TinyWebServer</em></body></html>";
-
-    buff.Append("Content-length: " + to_string(body.size()) + "\r\n\r\n");
-    buff.Append(body);
+    return body;
 }
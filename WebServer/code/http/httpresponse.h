@@ -2,13 +2,19 @@
 #define HTTP_RESPONSE_H
 
 #include <unordered_map>
-#include <fcntl.h>       // open
-#include <unistd.h>      // close
+#include <array>
+#include <vector>
+#include <algorithm>     // sort
+#include <string_view>
+#include <memory_resource>
+#include <charconv>      // to_chars
+#include <time.h>        // gmtime_r, strptime, timegm
+#include <strings.h>     // strncasecmp
 #include <sys/stat.h>    // stat
-#include <sys/mman.h>    // mmap, munmap
 
 #include "../buffer/buffer.h"
 #include "../log/log.h"
+#include "../cache/filecache.h"
 
 // 用于响应的结构体
 class HttpResponse {
@@ -16,34 +22,89 @@ public:
     HttpResponse();
     ~HttpResponse();
 
-    void Init(const std::string& srcDir, std::string& path, bool isKeepAlive = false, int code = -1);
+    void Init(std::string_view srcDir, std::string& path, bool isKeepAlive = false, int code = -1);
+    // 条件请求的If-None-Match和If-Modified-Since，指向请求的读缓冲区，在Init之后、MakeResponse之前设置；
+    // 文件没有变化时返回不带正文的304
+    void SetConditional(std::string_view ifNoneMatch, std::string_view ifModifiedSince);
+    // Accept-Encoding，同样指向请求的读缓冲区；接受gzip时文本类的文件发送压缩版本
+    void SetAcceptEncoding(std::string_view acceptEncoding) { acceptEncoding_ = acceptEncoding; }
+    // Range和If-Range，同样指向请求的读缓冲区，只对GET设置；满足时返回206，范围都超出文件时返回416
+    void SetRange(std::string_view range, std::string_view ifRange);
     void MakeResponse(Buffer& buff);
     void UnmapFile();
-    char* File();
-    size_t FileLen() const;
-    void ErrorContent(Buffer& buff, std::string message);
+
+    // 跟在buff中响应头后面依次发送的正文：内存中的数据(文件内容、预先生成的错误响应、多段Range的分隔行)；
+    // data为nullptr时是文件中的一段，用FileFd从offset处发送
+    struct Segment {
+        const char* data;
+        off_t offset;
+        size_t len;
+    };
+    const std::vector<Segment>& Body() const { return body_; }
+    int FileFd() const;             // 文件的描述符，没有时为-1
     int Code() const { return code_; }
+    // 生成响应时的临时字符串从arena中分配，默认直接用new/delete
+    void SetArena(std::pmr::memory_resource* arena) { arena_ = arena; }
 
-private:
-    void AddStateLine_(Buffer &buff);
-    void AddHeader_(Buffer &buff);
-    void AddContent_(Buffer &buff);
+    // 文件缓存的HeaderMaker：文件的校验值、编码和类型，Content-type在最后一行
+    static std::string FileHeader(const FileCache::File& file);
+    // 读取srcDir下的错误页面，生成各个错误码完整的响应(保持连接和不保持连接各一份)，启动时调用一次
+    // 之后错误页面在文件缓存中失效时(例如被文件监视发现修改)，下一个错误响应重新生成
+    static void LoadErrorPages(std::string_view srcDir);
 
-    void ErrorHtml_();
-    std::string GetFileType_();
+private:
+    std::pmr::string FilePath_() const;     // 资源文件的完整路径
+    static const std::string& GetFileType_(std::string_view path);
+    static void AppendNum_(Buffer& buff, size_t num);   // 数字直接写进缓冲区
+    static void AppendNum_(std::string& str, size_t num);
+    static std::string ErrorContent_(int code, std::string_view message);
+    // 预先生成的错误响应，和生成它的错误页面一起保存
+    struct Canned {
+        FileCache::FilePtr page;            // 错误页面在文件缓存中的条目，没有页面时为空
+        std::array<std::string, 2> resp;    // [0]不保持连接，[1]保持连接
+    };
+    typedef std::shared_ptr<const Canned> CannedPtr;
+    static CannedPtr MakeCanned_(int code);
+    static CannedPtr GetCanned_(int code);  // 没有这个错误码时返回nullptr
+    bool NotModified_() const;      // 条件请求的文件是否没有变化
+    bool IfRangeMatch_() const;
+    bool AcceptsGzip_() const;
+    static bool IsCompressible_(std::string_view path);   // 文本类的文件，压缩效果好
+    int ParseRange_();
+    void AddBody_(size_t offset, size_t len);
+    void AddMultipart_(Buffer& buff, std::string_view header);
+    static bool ParseDate_(std::string_view str, time_t* t);
+    static bool ParseNum_(std::string_view str, size_t* num);
 
     int code_;  // 响应状态码
     bool isKeepAlive_;  // 是否保持连接
+    std::string_view ifNoneMatch_, ifModifiedSince_;    // 条件请求头，只在MakeResponse中使用
+    std::string_view range_, ifRange_;
+    std::string_view acceptEncoding_;
+
+    static const int MAX_RANGES = 16;   // 一个请求最多的Range段数，超过时发送整个文件
+    static constexpr std::string_view BOUNDARY = "WEBSERVER_BYTERANGES_7d3c9a1e";
+    std::pair<size_t, size_t> ranges_[MAX_RANGES];  // 排序合并后的段，[首字节, 尾字节]
+    int rangeCnt_;
 
     std::string path_;  // 资源的路径
     std::string srcDir_;    // 资源的目录
     
-    char* mmFile_;  // 文件内存映射的指针
-    struct stat mmFileStat_;    // 文件的状态信息
+    // 请求的文件，和文件缓存共享，响应发完之前一直有效
+    FileCache::FilePtr file_;
+    CannedPtr canned_;              // 错误响应，页面更新后旧的响应在发完之前仍然有效
+    std::vector<Segment> body_;     // 正文的各段，和对象一起复用
+    std::string parts_;             // 多段Range响应的分隔行和段头，body_指向这里
+    std::pmr::memory_resource* arena_;
 
     static const std::unordered_map<std::string, std::string> SUFFIX_TYPE;  // 后缀 - 类型
     static const std::unordered_map<int, std::string> CODE_STATUS;    // 状态码 - 描述 
     static const std::unordered_map<int, std::string> CODE_PATH;      // 状态码 - 路径
+    // 状态码 - 状态行加Connection头，[0]不保持连接，[1]保持连接
+    static const std::unordered_map<int, std::array<std::string, 2>> STATUS_HEAD;
+    // 错误码 - 完整的错误响应，LoadErrorPages之后键不再变化，值用atomic_load/atomic_store替换
+    static std::unordered_map<int, CannedPtr> cannedResp_;
+    static std::string errorDir_;   // 错误页面所在的目录
 };
 
 
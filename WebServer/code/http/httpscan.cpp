@@ -0,0 +1,102 @@
+#include "httpscan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HTTP_SCAN_X86 1
+#endif
+
+namespace {
+
+// 逐字节的版本，也用来处理向量版本剩下的不足一个向量的尾部
+const char* FindCRLFScalar(const char* begin, const char* end) {
+    const char* p = begin;
+    while(p < end && (p = static_cast<const char*>(memchr(p, '\r', end - p)))) {
+        if(p + 1 < end && p[1] == '\n') { return p; }
+        p++;
+    }
+    return end;
+}
+
+const char* FindEolScalar(const char* begin, const char* end) {
+    for(const char* p = begin; p < end; p++) {
+        if(*p == '\r' || *p == '\n') { return p; }
+    }
+    return end;
+}
+
+#ifdef HTTP_SCAN_X86
+// 同时比较p和p+1处的16个字节，'\r'后紧跟'\n'的位置对应掩码中的1
+__attribute__((target("sse2")))
+const char* FindCRLFSse2(const char* begin, const char* end) {
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const char* p = begin;
+    for(; end - p >= 17; p += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1));
+        int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, cr), _mm_cmpeq_epi8(b, lf)));
+        if(mask) { return p + __builtin_ctz(mask); }
+    }
+    return FindCRLFScalar(p, end);
+}
+
+__attribute__((target("sse2")))
+const char* FindEolSse2(const char* begin, const char* end) {
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const char* p = begin;
+    for(; end - p >= 16; p += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(a, cr), _mm_cmpeq_epi8(a, lf)));
+        if(mask) { return p + __builtin_ctz(mask); }
+    }
+    return FindEolScalar(p, end);
+}
+
+// AVX2版本只对这两个函数启用，其余代码仍按默认指令集编译，不支持AVX2的机器不会执行到这里
+__attribute__((target("avx2")))
+const char* FindCRLFAvx2(const char* begin, const char* end) {
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const char* p = begin;
+    for(; end - p >= 33; p += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 1));
+        unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, cr), _mm256_cmpeq_epi8(b, lf)));
+        if(mask) { return p + __builtin_ctz(mask); }
+    }
+    return FindCRLFSse2(p, end);
+}
+
+__attribute__((target("avx2")))
+const char* FindEolAvx2(const char* begin, const char* end) {
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const char* p = begin;
+    for(; end - p >= 32; p += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(a, cr), _mm256_cmpeq_epi8(a, lf)));
+        if(mask) { return p + __builtin_ctz(mask); }
+    }
+    return FindEolSse2(p, end);
+}
+#endif
+
+} // namespace
+
+// 只找一到两种字符时两次pcmpeqb比SSE4.2的pcmpestri更快，所以x86上只区分AVX2和SSE2(x86-64必定支持)
+HttpScan::Kernels HttpScan::Select_() {
+#ifdef HTTP_SCAN_X86
+    // 在静态初始化阶段调用，需要先初始化CPU信息
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        return Kernels{ FindCRLFAvx2, FindEolAvx2, "avx2" };
+    }
+    if(__builtin_cpu_supports("sse2")) {
+        return Kernels{ FindCRLFSse2, FindEolSse2, "sse2" };
+    }
+#endif
+    return Kernels{ FindCRLFScalar, FindEolScalar, "scalar" };
+}
+
+const HttpScan::Kernels HttpScan::kernels_ = HttpScan::Select_();
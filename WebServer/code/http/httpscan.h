@@ -0,0 +1,37 @@
+#ifndef HTTP_SCAN_H
+#define HTTP_SCAN_H
+
+#include <stddef.h>
+#include <string.h>     // memchr()
+
+// 解析请求时的字节扫描，x86上一次比较16(SSE2)或32(AVX2)字节，
+// 具体实现在第一次使用前根据CPUID选定，其他平台使用逐字节的版本
+class HttpScan {
+public:
+    // 返回[begin, end)中第一个"\r\n"的'\r'位置，找不到时返回end(与std::search相同)
+    static const char* FindCRLF(const char* begin, const char* end) {
+        return kernels_.findCRLF(begin, end);
+    }
+
+    // 返回[begin, end)中第一个'\r'或'\n'的位置，找不到时返回end
+    static const char* FindEol(const char* begin, const char* end) {
+        return kernels_.findEol(begin, end);
+    }
+
+    // 选用的实现："avx2"、"sse2"或"scalar"
+    static const char* Backend() {
+        return kernels_.name;
+    }
+
+private:
+    typedef const char* (*ScanFunc)(const char* begin, const char* end);
+    struct Kernels {
+        ScanFunc findCRLF;
+        ScanFunc findEol;
+        const char* name;
+    };
+    static Kernels Select_();
+    static const Kernels kernels_;
+};
+
+#endif //HTTP_SCAN_H
@@ -0,0 +1,298 @@
+#include "router.h"
+using namespace std;
+
+namespace {
+
+const char FORM_TYPE[] = "application/x-www-form-urlencoded";
+
+// 访问根目录，默认表示访问index.html
+// 例如 http://192.168.110.111:10000/
+void IndexPage(HttpRequest& request) {
+    request.path() = "/index.html";
+}
+
+// 其他默认的一些页面，补上.html
+// 例如 http://192.168.110.111:10000/register
+void HtmlPage(HttpRequest& request) {
+    request.path() += ".html";
+}
+
+// 登录和注册页面提交的表单，UserVerify内部也实现了注册的功能
+// 验证成功(注册成功也会自动登录)来到欢迎界面，否则来到错误页面；不是表单时只返回页面
+void SubmitForm(HttpRequest& request, bool isLogin) {
+    string& path = request.path();
+    if(path.size() < 5 || path.compare(path.size() - 5, 5, ".html") != 0) {
+        path += ".html";
+    }
+    if(request.body().empty() || request.GetHeader(HttpRequest::CONTENT_TYPE) != FORM_TYPE) {
+        return;
+    }
+    if(HttpRequest::UserVerify(request.GetPost("username"), request.GetPost("password"), isLogin)) {
+        path = "/welcome.html";
+    }
+    else {
+        path = "/error.html";
+    }
+}
+
+void RegisterForm(HttpRequest& request) { SubmitForm(request, false); }
+void LoginForm(HttpRequest& request) { SubmitForm(request, true); }
+
+typedef void (*PageHandler)(HttpRequest&);
+
+struct StaticRoute {
+    Router::METHOD method;
+    const char* path;
+    PageHandler handler;
+};
+
+// 内置页面，编译期放进完美哈希表
+constexpr StaticRoute STATIC_ROUTES[] = {
+    {Router::ANY, "/", IndexPage},
+    {Router::ANY, "/index", HtmlPage},
+    {Router::ANY, "/register", HtmlPage},
+    {Router::ANY, "/login", HtmlPage},
+    {Router::ANY, "/welcome", HtmlPage},
+    {Router::ANY, "/video", HtmlPage},
+    {Router::ANY, "/picture", HtmlPage},
+    {Router::POST, "/register", RegisterForm},
+    {Router::POST, "/register.html", RegisterForm},
+    {Router::POST, "/login", LoginForm},
+    {Router::POST, "/login.html", LoginForm},
+};
+
+constexpr size_t Length(const char* str) {
+    size_t len = 0;
+    while(str[len]) { len++; }
+    return len;
+}
+
+constexpr uint32_t PathHash(const char* path, size_t len, uint32_t seed) {
+    uint32_t hash = 2166136261u ^ seed;
+    for(size_t i = 0; i < len; i++) {
+        hash = (hash ^ static_cast<unsigned char>(path[i])) * 16777619u;
+    }
+    return hash;
+}
+
+constexpr bool SamePath(const char* a, const char* b) {
+    while(*a && *a == *b) { a++; b++; }
+    return *a == *b;
+}
+
+// 完美哈希：编译期找一个种子，使每个不同的路径落在不同的槽里，同一路径不同方法的处理函数放在同一个槽
+const size_t ROUTE_SLOT_NUM = 32;
+
+struct RouteSlot {
+    const char* path;       // nullptr表示空槽
+    size_t len;
+    PageHandler handler[Router::METHOD_COUNT];
+};
+
+struct RouteTable {
+    uint32_t seed;
+    bool collision;         // 所有种子都有冲突
+    RouteSlot slot[ROUTE_SLOT_NUM];
+};
+
+constexpr bool TryRouteSeed(RouteTable& table, uint32_t seed) {
+    table = RouteTable{};
+    table.seed = seed;
+    for(const StaticRoute& route: STATIC_ROUTES) {
+        size_t len = Length(route.path);
+        RouteSlot& slot = table.slot[PathHash(route.path, len, seed) % ROUTE_SLOT_NUM];
+        if(slot.path != nullptr && !SamePath(slot.path, route.path)) { return false; }
+        slot.path = route.path;
+        slot.len = len;
+        slot.handler[route.method] = route.handler;
+    }
+    return true;
+}
+
+constexpr RouteTable MakeRouteTable() {
+    RouteTable table{};
+    for(uint32_t seed = 0; seed < 1024; seed++) {
+        if(TryRouteSeed(table, seed)) { return table; }
+    }
+    table.collision = true;
+    return table;
+}
+
+constexpr RouteTable ROUTE_TABLE = MakeRouteTable();
+static_assert(!ROUTE_TABLE.collision, "static routes must hash to distinct slots");
+
+// 在内置页面中查找，没有时返回nullptr
+PageHandler FindPage(string_view path, Router::METHOD method) {
+    const RouteSlot& slot = ROUTE_TABLE.slot[PathHash(path.data(), path.size(), ROUTE_TABLE.seed) % ROUTE_SLOT_NUM];
+    if(slot.path == nullptr || path != string_view(slot.path, slot.len)) { return nullptr; }
+    if(method != Router::METHOD_COUNT && slot.handler[method]) { return slot.handler[method]; }
+    return slot.handler[Router::ANY];
+}
+
+} // namespace
+
+Router::Router() {}
+
+Router* Router::Instance() {
+    static Router router;
+    return &router;
+}
+
+Router::METHOD Router::ToMethod(string_view method) {
+    static const char* NAMES[ANY] = { "GET", "POST", "HEAD", "PUT", "DELETE", "OPTIONS", "PATCH" };
+    for(int i = 0; i < ANY; i++) {
+        if(method == NAMES[i]) { return static_cast<METHOD>(i); }
+    }
+    return METHOD_COUNT;
+}
+
+bool Router::AddRoute(METHOD method, const string& pattern, RouteHandler handler, BodyHandler body) {
+    assert(method >= 0 && method < METHOD_COUNT);
+    Node* node = Insert_(pattern);
+    if(node == nullptr) {
+        LOG_ERROR("Route %s error!", pattern.c_str());
+        return false;
+    }
+    node->handler[method] = std::move(handler);
+    node->body[method] = std::move(body);
+    return true;
+}
+
+// 沿着pattern插入节点，返回最后一个节点；格式不对或参数名冲突时返回nullptr
+Router::Node* Router::Insert_(string_view pattern) {
+    if(pattern.empty() || pattern[0] != '/') { return nullptr; }
+    Node* node = &root_;
+    int paramCnt = 0;
+    while(!pattern.empty()) {
+        if(pattern[0] == ':' || pattern[0] == '*') {
+            bool isParam = (pattern[0] == ':');
+            size_t end = (isParam ? min(pattern.find('/'), pattern.size()): pattern.size());
+            string_view name = pattern.substr(1, end - 1);
+            if(name.empty() || name.find_first_of(":*/") != string_view::npos
+               || ++paramCnt > HttpRequest::MAX_PARAMS) {
+                return nullptr;
+            }
+            unique_ptr<Node>& child = (isParam ? node->param: node->catchAll);
+            if(!child) {
+                child = make_unique<Node>();
+                child->prefix = string(name);
+            }
+            else if(child->prefix != name) {
+                return nullptr;
+            }
+            node = child.get();
+            pattern.remove_prefix(end);
+            continue;
+        }
+        // 静态部分到下一个参数为止
+        string_view seg = pattern.substr(0, min(pattern.find_first_of(":*"), pattern.size()));
+        Node* next = nullptr;
+        for(auto& child: node->children) {
+            if(child->prefix[0] == seg[0]) {
+                next = child.get();
+                break;
+            }
+        }
+        if(next == nullptr) {
+            node->children.push_back(make_unique<Node>());
+            next = node->children.back().get();
+            next->prefix = string(seg);
+        }
+        size_t common = 0;
+        while(common < seg.size() && common < next->prefix.size() && seg[common] == next->prefix[common]) {
+            common++;
+        }
+        if(common < next->prefix.size()) {
+            // 只匹配了一部分：公共部分留在原节点，其余部分连同后代下移成为它的子节点
+            auto rest = make_unique<Node>();
+            rest->prefix = next->prefix.substr(common);
+            rest->children = std::move(next->children);
+            rest->param = std::move(next->param);
+            rest->catchAll = std::move(next->catchAll);
+            for(int i = 0; i < METHOD_COUNT; i++) {
+                rest->handler[i] = std::move(next->handler[i]);
+                rest->body[i] = std::move(next->body[i]);
+                next->handler[i] = nullptr;
+                next->body[i] = nullptr;
+            }
+            next->prefix.resize(common);
+            next->children.clear();
+            next->children.push_back(std::move(rest));
+        }
+        node = next;
+        pattern.remove_prefix(common);
+    }
+    return node;
+}
+
+// 返回方法对应的处理函数下标，没有时用ANY，都没有时返回-1
+int Router::Find_(const Node* node, METHOD method) {
+    if(method != METHOD_COUNT && node->handler[method]) { return method; }
+    if(node->handler[ANY]) { return ANY; }
+    return -1;
+}
+
+// 静态子节点优先于参数，参数优先于通配；一条路走不通时退回来换下一种
+const Router::Node* Router::Match_(const Node* node, string_view path,
+                                   METHOD method, HttpRequest& request, int& slot) const {
+    if(path.empty()) {
+        slot = Find_(node, method);
+        if(slot >= 0) { return node; }
+        if(!node->catchAll) { return nullptr; }
+    }
+    for(auto& child: node->children) {
+        if(!path.empty() && child->prefix[0] == path[0] && path.compare(0, child->prefix.size(), child->prefix) == 0) {
+            const Node* found = Match_(child.get(), path.substr(child->prefix.size()), method, request, slot);
+            if(found) { return found; }
+            break;
+        }
+    }
+    int paramCnt = request.paramCnt_;
+    if(node->param) {
+        size_t end = min(path.find('/'), path.size());
+        if(end > 0) {
+            request.params_[request.paramCnt_++] = { node->param->prefix, path.substr(0, end) };
+            const Node* found = Match_(node->param.get(), path.substr(end), method, request, slot);
+            if(found) { return found; }
+            request.paramCnt_ = paramCnt;
+        }
+    }
+    if(node->catchAll) {
+        slot = Find_(node->catchAll.get(), method);
+        if(slot >= 0) {
+            request.params_[request.paramCnt_++] = { node->catchAll->prefix, path };
+            return node->catchAll.get();
+        }
+    }
+    return nullptr;
+}
+
+// 在注册的路由中查找，同时填写路径参数；没有匹配时返回nullptr
+const Router::Node* Router::Route_(HttpRequest& request, int& slot) const {
+    request.paramCnt_ = 0;
+    if(request.path_.empty()) { return nullptr; }
+    const Node* node = Match_(&root_, request.path_, ToMethod(request.method_), request, slot);
+    if(node == nullptr) { request.paramCnt_ = 0; }
+    return node;
+}
+
+bool Router::Dispatch(HttpRequest& request) const {
+    PageHandler page = FindPage(request.path_, ToMethod(request.method_));
+    if(page) {
+        page(request);
+        return true;
+    }
+    int slot = -1;
+    const Node* node = Route_(request, slot);
+    if(node == nullptr) { return false; }
+    node->handler[slot](request);
+    return true;
+}
+
+const Router::BodyHandler* Router::FindBodyHandler(HttpRequest& request) const {
+    if(FindPage(request.path_, ToMethod(request.method_))) { return nullptr; }
+    int slot = -1;
+    const Node* node = Route_(request, slot);
+    if(node == nullptr || !node->body[slot]) { return nullptr; }
+    return &node->body[slot];
+}
@@ -0,0 +1,78 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <functional>
+
+#include "httprequest.h"
+#include "../log/log.h"
+
+// 路由：按请求方法和路径找到处理函数
+// 内置页面(/index、/login等)放在编译期生成的完美哈希表中；
+// 通过AddRoute注册的路由放在基数树中，支持":name"参数和结尾的"*name"通配
+// 路由在服务器启动前注册，之后只读，多个线程同时Dispatch不需要加锁
+class Router {
+public:
+    enum METHOD {
+        GET = 0,
+        POST,
+        HEAD,
+        PUT,
+        DELETE,
+        OPTIONS,
+        PATCH,
+        ANY,            // 匹配任意方法，同一路径上具体方法的处理函数优先
+        METHOD_COUNT,
+    };
+
+    // 处理函数可以改写请求的路径(决定返回哪个文件)，或者读取表单、请求头、路径参数
+    typedef std::function<void(HttpRequest&)> RouteHandler;
+    typedef HttpRequest::BodyHandler BodyHandler;
+
+    // 单例模式
+    static Router* Instance();
+
+    // 注册路由，pattern必须以'/'开头：":name"匹配一段(到下一个'/'为止)，
+    // "*name"只能在最后，匹配剩下的全部；同一方法同一路径重复注册时覆盖之前的
+    // pattern格式不对或者同一位置的参数名冲突时返回false
+    // body不为空时，请求体边收边交给它处理(例如写入文件)，之后再调用handler
+    bool AddRoute(METHOD method, const std::string& pattern, RouteHandler handler,
+                  BodyHandler body = nullptr);
+
+    // 按请求的方法和路径调用处理函数，先查内置页面再查注册的路由，没有匹配时返回false
+    // 查找只和路径长度有关，不分配内存
+    bool Dispatch(HttpRequest& request) const;
+
+    // 请求头解析完、请求体到达之前调用，返回匹配的路由注册的请求体处理函数，没有时返回nullptr
+    // 内置页面没有请求体处理函数；路径参数在请求体处理函数中已经可以使用
+    const BodyHandler* FindBodyHandler(HttpRequest& request) const;
+
+    static METHOD ToMethod(std::string_view method);
+
+private:
+    Router();
+    ~Router() = default;
+
+    struct Node {
+        std::string prefix;     // 静态节点为这一段路径，参数节点为参数名
+        std::vector<std::unique_ptr<Node>> children;    // 静态子节点，首字符各不相同
+        std::unique_ptr<Node> param;        // ":name"子节点
+        std::unique_ptr<Node> catchAll;     // "*name"子节点，没有后代
+        RouteHandler handler[METHOD_COUNT];
+        BodyHandler body[METHOD_COUNT];     // 和handler一起注册
+    };
+
+    Node* Insert_(std::string_view pattern);
+    // 匹配成功时返回节点，slot为其中处理函数的下标
+    const Node* Match_(const Node* node, std::string_view path,
+                       METHOD method, HttpRequest& request, int& slot) const;
+    static int Find_(const Node* node, METHOD method);
+    const Node* Route_(HttpRequest& request, int& slot) const;
+
+    Node root_;     // 根节点的前缀为空
+};
+
+#endif //ROUTER_H
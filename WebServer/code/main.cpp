@@ -8,7 +8,21 @@ int main() {
     WebServer server(
         1316, 3, 60000, false,             /* 端口 ET模式 timeoutMs 优雅退出  */
         3306, "root", "369132", "webserver", /* Mysql配置 ：mysql端口号，用户名，密码，数据库名*/
-        12, 6, true, 1, 1024);             /* 连接池数量 线程池数量 日志开关 日志等级 日志异步队列容量 */
+        12, 6, true, 1, 1024,              /* 连接池数量 线程池数量 日志开关 日志等级 日志异步队列容量 */
+        WebServer::SINGLE_REACTOR,         /* Reactor模式：SINGLE_REACTOR 单Reactor+线程池，MULTI_REACTOR 每线程一个事件循环(数量取线程池数量)，
+                                              MAIN_SUB_REACTOR 主Reactor accept后分发给从Reactor(数量取线程池数量) */
+        WebServer::ROUND_ROBIN,            /* 主从模式下新连接分发策略：ROUND_ROBIN 轮询，LEAST_LOADED 最少连接，
+                                              INCOMING_CPU 交给绑在收包CPU上的从Reactor */
+        Epoller::EPOLL,                    /* 事件后端：EPOLL，IO_URING(内核不支持时自动回退到epoll) */
+        1024, 64,                          /* listen队列长度 每轮事件循环最多accept的连接数 */
+        5,                                 /* 线程池任务排队时间目标(毫秒)，持续超过即返回503，0为关闭 */
+        nullptr,                           /* 绑核的CPU列表，如"0-3,8"，依次分给事件循环、线程池线程和日志线程；
+                                              多Reactor模式下同时按收包CPU分发新连接，nullptr为不绑核 */
+        16,                                /* 一个连接一批最多处理的流水线请求数，它们的响应合并成一次写 */
+        8192, 1024 * 1024,                 /* 请求行加请求头的最大字节数(超过返回431) 请求体的最大字节数(超过返回413) */
+        64,                                /* 静态文件缓存的大小(MB)，打开的文件和映射在连接之间共享，0为不缓存 */
+        256,                               /* 超过这个大小(KB)的文件不映射，用sendfile从页缓存直接发送，0为都用映射 */
+        true);                             /* 用inotify监视资源目录，文件修改、替换、删除后缓存自动失效，不用重启 */
 
 
     // 启动服务器
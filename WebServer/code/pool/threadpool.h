@@ -6,18 +6,28 @@
 #include <queue>
 #include <thread>
 #include <functional>
+#include <chrono>
+#include <atomic>
+#include <vector>
+#include <assert.h>
+#include <pthread.h>    // pthread_setaffinity_np()
 class ThreadPool {
 public:
     /* C++中的explicit关键字只能用于修饰只有一个参数的类构造函数
     它的作用是表明该构造函数是显示的, 而非隐式的, 跟它相对应的另一个关键字是implicit, 意思是隐藏的,类构造函数默认情况下即声明为implicit(隐式). */
-    explicit ThreadPool(size_t threadCount = 8): pool_(std::make_shared<Pool>()) {
+    // targetMs > 0 时开启过载判断：任务在队列中的等待时间持续intervalMs都不低于targetMs，即认为过载(CoDel)
+    // cpus非空时第i个线程绑定到cpus[i % cpus.size()]
+    explicit ThreadPool(size_t threadCount = 8, int targetMs = 0, int intervalMs = 100,
+                        const std::vector<int>& cpus = std::vector<int>()): pool_(std::make_shared<Pool>()) {
             assert(threadCount > 0);
+            pool_->target = std::chrono::milliseconds(targetMs);
+            pool_->interval = std::chrono::milliseconds(intervalMs);
 
             // 创建threadCount个子线程
             // 每个子线程都在循环等待任务
             for(size_t i = 0; i < threadCount; i++) {
                 // thread创建线程参数是一个匿名函数
-                std::thread([pool = pool_] {
+                std::thread worker([pool = pool_] {
 
                     // 申请互斥锁
                     // std::unique_lock为锁管理模板类，是对通用mutex的封装
@@ -29,11 +39,13 @@ public:
                             auto task = std::move(pool->tasks.front());
                             // 移除掉队列中第一个元素
                             pool->tasks.pop();
+                            // 根据任务的排队时间更新过载状态
+                            pool->OnDequeue(task.enqueue);
 
                             // 取任务的时候是互斥的，只能有一个线程在取任务
                             // 取完任务就解锁
                             locker.unlock();
-                            task();
+                            task.fn();
 
                             // 执行完任务后就加锁
                             locker.lock();
@@ -42,9 +54,20 @@ public:
 
                         // 阻塞等待条件变量，释放互斥锁
                         // 当被唤醒时，即这个函数返回，解除阻塞并重新获取互斥锁
-                        else pool->cond.wait(locker);   // 如果队列为空，等待
+                        else {
+                            // 队列已经排空，不再处于过载状态
+                            pool->ResetDelay();
+                            pool->cond.wait(locker);   // 如果队列为空，等待
+                        }
                     }
-                }).detach();// 线程分离
+                });
+                if(!cpus.empty()) {
+                    cpu_set_t set;
+                    CPU_ZERO(&set);
+                    CPU_SET(cpus[i % cpus.size()], &set);
+                    pthread_setaffinity_np(worker.native_handle(), sizeof(set), &set);
+                }
+                worker.detach();// 线程分离
                 // 线程分离，线程一旦终止就立刻回收它占用的所有资源，而不保留终止状态。
             }
     }
@@ -73,13 +96,26 @@ public:
             // 采用”资源分配时初始化”(RAII)方法来加锁、解锁，这避免了在临界区中因为抛出异常或return等操作导致没有解锁就退出的问题
             // 在lock_guard对象被析构时，它所管理的mutex对象会自动解锁，不需要程序员手动调用lock和unlock对mutex进行上锁和解锁操作
             std::lock_guard<std::mutex> locker(pool_->mtx);
-            pool_->tasks.emplace(std::forward<F>(task));
+            pool_->tasks.push(Task{std::forward<F>(task), Clock::now()});
         }
         // 多个线程会抢占一个任务，只有一个能抢到
         pool_->cond.notify_one();   // 唤醒一个等待的线程
     }
 
+    // 任务排队时间持续超过目标值，新的请求应当被拒绝
+    bool IsOverloaded() const {
+        return pool_ && pool_->overloaded.load(std::memory_order_relaxed);
+    }
+
 private:
+    typedef std::chrono::steady_clock Clock;
+
+    // 任务及其入队时间
+    struct Task {
+        std::function<void()> fn;
+        Clock::time_point enqueue;
+    };
+
     // 结构体
     struct Pool {
         // 同一个锁反复使用？
@@ -88,7 +124,31 @@ private:
         bool isClosed;          // 是否关闭
 
         // std::function可以取代函数指针的作用，因为它可以延迟函数的执行，特别适合作为回调函数使用。它比普通函数指针更加的灵活和便利
-        std::queue<std::function<void()>> tasks;    // 队列（保存的是任务）
+        std::queue<Task> tasks;    // 队列（保存的是任务）
+
+        // CoDel：排队时间第一次超过target后，如果interval内一直没有降到target以下，就进入过载状态
+        Clock::duration target;
+        Clock::duration interval;
+        Clock::time_point firstAbove;       // 排队时间超过target的时刻 + interval，零值表示未超过
+        std::atomic<bool> overloaded;
+
+        // 取出任务时调用，持有mtx
+        void OnDequeue(Clock::time_point enqueue) {
+            if(target.count() <= 0) { return; }
+            Clock::time_point now = Clock::now();
+            if(now - enqueue < target) {
+                ResetDelay();
+            } else if(firstAbove == Clock::time_point()) {
+                firstAbove = now + interval;
+            } else if(now >= firstAbove) {
+                overloaded.store(true, std::memory_order_relaxed);
+            }
+        }
+
+        void ResetDelay() {
+            firstAbove = Clock::time_point();
+            overloaded.store(false, std::memory_order_relaxed);
+        }
     };
     std::shared_ptr<Pool> pool_;  //  池子
 };
@@ -1,12 +1,27 @@
 #include "epoller.h"
+#include "uringepoller.h"
 
 // 创建epoll对象 epoll_create(512)
-Epoller::Epoller(int maxEvent):epollFd_(epoll_create(512)), events_(maxEvent){
+Epoller::Epoller(int maxEvent, int maxFd):epollFd_(epoll_create(512)), interest_(maxFd), events_(maxEvent){
     assert(epollFd_ >= 0 && events_.size() > 0);
 }
 
+Epoller::Epoller(int maxEvent, bool createEpoll):
+    epollFd_(createEpoll ? epoll_create(512) : -1), events_(maxEvent) {
+    assert(events_.size() > 0);
+}
+
 Epoller::~Epoller() {
-    close(epollFd_);
+    if(epollFd_ >= 0) { close(epollFd_); }
+}
+
+Epoller* Epoller::Create(int backend, int maxEvent, int maxFd, bool io) {
+    if(backend == IO_URING) {
+        UringEpoller* uring = new UringEpoller(maxEvent, io);
+        if(uring->IsOpen()) { return uring; }
+        delete uring;
+    }
+    return new Epoller(maxEvent, maxFd);
 }
 
 // 添加文件描述符到epoll中进行管理
@@ -16,21 +31,31 @@ bool Epoller::AddFd(int fd, uint32_t events) {
     ev.data.fd = fd;
     ev.events = events;
     // 上树成功返回0，失败返回-1
-    return 0 == epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev);
+    if(0 != epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev)) { return false; }
+    if(static_cast<size_t>(fd) < interest_.size()) { interest_[fd] = events; }
+    return true;
 }
 
 // 修改
 bool Epoller::ModFd(int fd, uint32_t events) {
     if(fd < 0) return false;
+    // EPOLLONESHOT触发后必须重新设置；否则监听事件没有变化时内核里的状态也不用变
+    bool cached = static_cast<size_t>(fd) < interest_.size();
+    if(cached && !(events & EPOLLONESHOT) && interest_[fd] == events) {
+        return true;
+    }
     epoll_event ev = {0};
     ev.data.fd = fd;
     ev.events = events;
-    return 0 == epoll_ctl(epollFd_, EPOLL_CTL_MOD, fd, &ev);
+    if(0 != epoll_ctl(epollFd_, EPOLL_CTL_MOD, fd, &ev)) { return false; }
+    if(cached) { interest_[fd] = events; }
+    return true;
 }
 
 // 删除
 bool Epoller::DelFd(int fd) {
     if(fd < 0) return false;
+    if(static_cast<size_t>(fd) < interest_.size()) { interest_[fd] = 0; }
     epoll_event ev = {0};
     return 0 == epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, &ev);
 }
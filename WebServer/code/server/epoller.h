@@ -2,6 +2,7 @@
 #define EPOLLER_H
 
 #include <sys/epoll.h> //epoll_ctl()
+#include <sys/socket.h> // msghdr
 #include <fcntl.h>  // fcntl()
 #include <unistd.h> // close()
 #include <assert.h> // close()
@@ -10,32 +11,84 @@
 
 class Epoller {
 public:
-    // 监听事件数最大为1024
-    explicit Epoller(int maxEvent = 1024);
+    // 事件后端
+    enum BACKEND {
+        EPOLL = 0,  // epoll_wait/epoll_ctl
+        IO_URING,   // io_uring的poll请求，修改监听事件随下一次等待批量提交；完成模式下直接提交accept、recv、send
+    };
+
+    // 完成模式下Wait返回的操作结果的类型
+    enum IO_KIND {
+        IO_NONE = 0,    // 普通的就绪事件
+        IO_ACCEPT,      // res为新连接的fd
+        IO_RECV,        // res为收到的字节数，0为对端关闭；数据在data中，下一次Wait之前有效
+        IO_SEND,        // res为发出的字节数
+    };
+
+    // 操作的结果，res小于0时为-errno
+    struct IoEvent {
+        int kind;
+        int res;
+        const char* data;
+    };
+
+    // 监听事件数最大为1024，maxFd以内的fd会缓存其监听事件
+    explicit Epoller(int maxEvent = 1024, int maxFd = 65536);
 
     // 析构函数
-    ~Epoller();
+    virtual ~Epoller();
+
+    // 按后端类型创建对象，io_uring不可用(内核过旧或被禁用)时回退到epoll
+    // io为true时请求完成模式，只能在事件循环线程上处理连接时使用，后端不支持时HasIo()为false
+    static Epoller* Create(int backend, int maxEvent = 1024, int maxFd = 65536, bool io = false);
+
+    // 实际使用的后端
+    virtual int Backend() const { return EPOLL; }
 
     // 添加监听事件
-    bool AddFd(int fd, uint32_t events);
+    virtual bool AddFd(int fd, uint32_t events);
 
-    // 修改监听事件
-    bool ModFd(int fd, uint32_t events);
+    // 修改监听事件，不带EPOLLONESHOT且与当前监听事件相同时不做系统调用
+    virtual bool ModFd(int fd, uint32_t events);
 
     // 删除监听
-    bool DelFd(int fd);
+    virtual bool DelFd(int fd);
 
     // 超时等待
-    int Wait(int timeoutMs = -1);
+    virtual int Wait(int timeoutMs = -1);
 
     // 获取事件
     int GetEventFd(size_t i) const;
 
     uint32_t GetEvents(size_t i) const;
 
-private:
+    // 完成模式：由后端直接完成accept、接收和发送，结果和就绪事件一起由Wait返回，epoll不支持
+    virtual bool HasIo() const { return false; }
+
+    // 持续accept，每个新连接一个IO_ACCEPT事件
+    virtual bool Accept(int listenFd) { return false; }
+
+    // 持续接收，每段数据一个IO_RECV事件
+    virtual bool Recv(int fd) { return false; }
+
+    // 发送一次，完成时一个IO_SEND事件；msg和它指向的数据在完成之前必须有效
+    virtual bool Send(int fd, const struct msghdr* msg, int flags) { return false; }
+
+    // 关闭fd之前调用，取消上面的操作；还有发送没有完成时返回true，要等它的IO_SEND事件之后再关闭
+    virtual bool CancelIo(int fd) { return false; }
+
+    // 第i个事件是操作结果时返回它，普通的就绪事件返回nullptr
+    virtual const IoEvent* GetIoEvent(size_t i) const { return nullptr; }
+
+protected:
+    // 供其他后端使用，只分配事件数组，不创建epoll对象
+    Epoller(int maxEvent, bool createEpoll);
+
     int epollFd_;   // epoll_create()创建一个epoll对象，返回值就是epollFd
 
+    // 以fd为下标记录当前监听的事件，0表示未监听；大小固定，线程池并发修改不同fd时不会扩容
+    std::vector<uint32_t> interest_;
+
     std::vector<struct epoll_event> events_;     // 检测到的事件的集合
     /*
     // 描述事件类的结构体
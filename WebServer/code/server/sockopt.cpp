@@ -0,0 +1,37 @@
+#include "sockopt.h"
+
+bool SockOpt::SetLinger(int fd, bool on, int lingerS) {
+    assert(fd >= 0);
+    struct linger optLinger = { 0 };
+    if(on) {
+        /* 优雅关闭: 直到所剩数据发送完毕或超时 */
+        optLinger.l_onoff = 1;
+        optLinger.l_linger = lingerS;
+    }
+    return setsockopt(fd, SOL_SOCKET, SO_LINGER, &optLinger, sizeof(optLinger)) == 0;
+}
+
+bool SockOpt::SetReuseAddr(int fd) {
+    return SetInt_(fd, SOL_SOCKET, SO_REUSEADDR, 1);
+}
+
+bool SockOpt::SetReusePort(int fd) {
+    return SetInt_(fd, SOL_SOCKET, SO_REUSEPORT, 1);
+}
+
+bool SockOpt::SetDeferAccept(int fd, int timeoutS) {
+    return SetInt_(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, timeoutS);
+}
+
+bool SockOpt::SetFastOpen(int fd, int qlen) {
+    return SetInt_(fd, IPPROTO_TCP, TCP_FASTOPEN, qlen);
+}
+
+bool SockOpt::SetNoDelay(int fd, bool on) {
+    return SetInt_(fd, IPPROTO_TCP, TCP_NODELAY, on ? 1 : 0);
+}
+
+bool SockOpt::SetInt_(int fd, int level, int name, int val) {
+    assert(fd >= 0);
+    return setsockopt(fd, level, name, &val, sizeof(val)) == 0;
+}
@@ -0,0 +1,36 @@
+#ifndef SOCKOPT_H
+#define SOCKOPT_H
+
+#include <sys/socket.h>     // setsockopt()
+#include <netinet/in.h>     // IPPROTO_TCP
+#include <netinet/tcp.h>    // TCP_NODELAY TCP_DEFER_ACCEPT TCP_FASTOPEN
+#include <assert.h>
+
+// 套接字选项的封装，成功返回true，失败时errno由setsockopt设置，由调用者决定是否记录日志
+class SockOpt {
+public:
+    // 关闭时等待未发送的数据，最多lingerS秒；on为false时恢复默认的close行为
+    static bool SetLinger(int fd, bool on, int lingerS = 1);
+
+    static bool SetReuseAddr(int fd);
+
+    // 多个套接字绑定同一端口，由内核在它们之间分发新连接
+    static bool SetReusePort(int fd);
+
+    // 监听套接字：三次握手完成后不立即唤醒accept，等到客户端发来数据(最多等待timeoutS秒)，
+    // 省去一次只能得到EAGAIN的读事件
+    static bool SetDeferAccept(int fd, int timeoutS);
+
+    // 监听套接字：开启TCP Fast Open，qlen为尚未完成三次握手的TFO请求队列长度，
+    // 客户端再次连接时可以在SYN中携带请求，省去一个往返
+    static bool SetFastOpen(int fd, int qlen);
+
+    // 关闭Nagle算法，响应的最后一个不满MSS的报文不必等上一个报文的ACK；
+    // 设在监听套接字上时accept得到的连接会继承
+    static bool SetNoDelay(int fd, bool on = true);
+
+private:
+    static bool SetInt_(int fd, int level, int name, int val);
+};
+
+#endif //SOCKOPT_H
@@ -0,0 +1,441 @@
+#include "uringepoller.h"
+
+UringEpoller::UringEpoller(int maxEvent, bool io): Epoller(maxEvent, false), ringFd_(-1),
+    sqRing_(MAP_FAILED), sqRingSize_(0), sqes_(static_cast<io_uring_sqe*>(MAP_FAILED)), sqesSize_(0),
+    cqRing_(MAP_FAILED), cqRingSize_(0), bufRing_(nullptr), bufRingSize_(0), bufTail_(0),
+    ioEvents_(maxEvent) {
+    // 提交队列和事件数组同样大小，完成队列由内核默认取两倍
+    if(!InitRing_(static_cast<unsigned>(maxEvent))) {
+        UnmapRing_();
+        return;
+    }
+    // 注册失败时(内核不支持)只用poll请求
+    if(io) { InitBufRing_(); }
+}
+
+UringEpoller::~UringEpoller() {
+    UnmapRing_();
+    if(bufRing_) { munmap(bufRing_, bufRingSize_); }
+}
+
+bool UringEpoller::InitRing_(unsigned entries) {
+    io_uring_params params = {};
+    ringFd_ = syscall(__NR_io_uring_setup, entries, &params);
+    if(ringFd_ < 0) { return false; }
+    // 需要带超时的等待(5.11)，multishot poll与RSRC_TAGS同版本引入(5.13)
+    if(!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_RSRC_TAGS)) {
+        return false;
+    }
+
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if(params.features & IORING_FEAT_SINGLE_MMAP) {
+        sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+    }
+    sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   ringFd_, IORING_OFF_SQ_RING);
+    if(sqRing_ == MAP_FAILED) { return false; }
+    if(params.features & IORING_FEAT_SINGLE_MMAP) {
+        cqRing_ = sqRing_;
+    } else {
+        cqRing_ = mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ringFd_, IORING_OFF_CQ_RING);
+        if(cqRing_ == MAP_FAILED) { return false; }
+    }
+    sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe*>(mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE,
+                                            MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQES));
+    if(sqes_ == MAP_FAILED) { return false; }
+
+    char* sq = static_cast<char*>(sqRing_);
+    sqHead_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask_ = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqArray_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sqEntries_ = params.sq_entries;
+
+    char* cq = static_cast<char*>(cqRing_);
+    cqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask_ = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+}
+
+void UringEpoller::UnmapRing_() {
+    if(sqes_ != MAP_FAILED) { munmap(sqes_, sqesSize_); }
+    if(cqRing_ != MAP_FAILED && cqRing_ != sqRing_) { munmap(cqRing_, cqRingSize_); }
+    if(sqRing_ != MAP_FAILED) { munmap(sqRing_, sqRingSize_); }
+    sqes_ = static_cast<io_uring_sqe*>(MAP_FAILED);
+    sqRing_ = cqRing_ = MAP_FAILED;
+    if(ringFd_ >= 0) {
+        close(ringFd_);
+        ringFd_ = -1;
+    }
+}
+
+bool UringEpoller::InitBufRing_() {
+    // 缓冲区环需要按页对齐(5.19)
+    bufRingSize_ = BUF_NUM * sizeof(io_uring_buf);
+    void* ring = mmap(nullptr, bufRingSize_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(ring == MAP_FAILED) { return false; }
+    io_uring_buf_reg reg = {};
+    reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+    reg.ring_entries = BUF_NUM;
+    reg.bgid = BUF_GROUP;
+    if(syscall(__NR_io_uring_register, ringFd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        munmap(ring, bufRingSize_);
+        return false;
+    }
+    bufRing_ = static_cast<io_uring_buf_ring*>(ring);
+    bufs_.reset(new char[BUF_NUM * BUF_SIZE]);
+    for(unsigned i = 0; i < BUF_NUM; i++) {
+        usedBufs_.push_back(static_cast<uint16_t>(i));
+    }
+    RecycleBufs_();
+    return true;
+}
+
+void UringEpoller::RecycleBufs_() {
+    if(usedBufs_.empty()) { return; }
+    for(uint16_t bid: usedBufs_) {
+        // 头文件中的柔性数组在C++下前面多了一个空结构体，偏移不是0，直接按数组访问
+        io_uring_buf* buf = reinterpret_cast<io_uring_buf*>(bufRing_) + (bufTail_ & (BUF_NUM - 1));
+        buf->addr = reinterpret_cast<uint64_t>(bufs_.get() + static_cast<size_t>(bid) * BUF_SIZE);
+        buf->len = BUF_SIZE;
+        buf->bid = bid;
+        bufTail_++;
+    }
+    usedBufs_.clear();
+    // 尾指针与第一个缓冲区的保留字段重叠，填好之后再发布
+    __atomic_store_n(&bufRing_->tail, bufTail_, __ATOMIC_RELEASE);
+}
+
+UringEpoller::FdState& UringEpoller::State_(int fd) {
+    if(static_cast<size_t>(fd) >= states_.size()) {
+        states_.resize(fd + 1, FdState{0, 0, false, 0, false, false, false, false});
+    }
+    return states_[fd];
+}
+
+unsigned UringEpoller::Unsubmitted_() const {
+    return *sqTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+}
+
+io_uring_sqe* UringEpoller::GetSqe_() {
+    if(Unsubmitted_() >= sqEntries_) {
+        // 提交队列满了，先把已有的请求交给内核；内核暂时不收(如完成队列积压)时交给调用者处理
+        Enter_(Unsubmitted_(), 0, 0);
+        if(Unsubmitted_() >= sqEntries_) { return nullptr; }
+    }
+    unsigned tail = *sqTail_;
+    unsigned idx = tail & *sqMask_;
+    io_uring_sqe* sqe = &sqes_[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqArray_[idx] = idx;
+    __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+    return sqe;
+}
+
+bool UringEpoller::PrepPoll_(int fd) {
+    FdState& st = states_[fd];
+    io_uring_sqe* sqe = GetSqe_();
+    if(!sqe) { return false; }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    // io_uring的multishot poll是边沿触发的，只用于EPOLLET；
+    // 水平触发用单次请求，在Reap_中重新提交，随下一次Wait生效时正好反映处理之后的就绪状态
+    sqe->poll32_events = st.events & ~(EPOLLONESHOT | EPOLLET);
+    if((st.events & EPOLLET) && !(st.events & EPOLLONESHOT)) {
+        sqe->len = IORING_POLL_ADD_MULTI;
+    }
+    sqe->user_data = PackData_(fd, st.gen);
+    st.armed = true;
+    return true;
+}
+
+bool UringEpoller::PrepRemove_(int fd) {
+    FdState& st = states_[fd];
+    io_uring_sqe* sqe = GetSqe_();
+    if(!sqe) { return false; }
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = PackData_(fd, st.gen);
+    sqe->user_data = REMOVE_TAG;
+    st.armed = false;
+    return true;
+}
+
+bool UringEpoller::PrepAccept_(int fd) {
+    FdState& st = states_[fd];
+    io_uring_sqe* sqe = GetSqe_();
+    if(!sqe) { return false; }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = PackData_(fd, st.ioGen, OP_ACCEPT);
+    st.accepting = true;
+    return true;
+}
+
+bool UringEpoller::PrepRecv_(int fd) {
+    FdState& st = states_[fd];
+    io_uring_sqe* sqe = GetSqe_();
+    if(!sqe) { return false; }
+    // 长度为0，每次由内核从缓冲区组中取一个缓冲区
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUF_GROUP;
+    sqe->user_data = PackData_(fd, st.ioGen, OP_RECV);
+    st.receiving = true;
+    return true;
+}
+
+bool UringEpoller::PrepCancel_(uint64_t data) {
+    io_uring_sqe* sqe = GetSqe_();
+    if(!sqe) { return false; }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = data;
+    sqe->user_data = REMOVE_TAG;
+    return true;
+}
+
+bool UringEpoller::FlushForeign_() {
+    if(loopThread_.load() == std::this_thread::get_id()) { return true; }
+    unsigned toSubmit = Unsubmitted_();
+    return toSubmit == 0 || Enter_(toSubmit, 0, 0) >= 0;
+}
+
+int UringEpoller::Enter_(unsigned toSubmit, unsigned minComplete, int timeoutMs) {
+    unsigned flags = 0;
+    io_uring_getevents_arg arg = {};
+    struct __kernel_timespec ts = {};
+    if(minComplete > 0) {
+        flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        if(timeoutMs >= 0) {
+            ts.tv_sec = timeoutMs / 1000;
+            ts.tv_nsec = (timeoutMs % 1000) * 1000000LL;
+            arg.ts = reinterpret_cast<uint64_t>(&ts);
+        }
+    }
+    return syscall(__NR_io_uring_enter, ringFd_, toSubmit, minComplete, flags,
+                   minComplete > 0 ? &arg : nullptr, minComplete > 0 ? sizeof(arg) : 0);
+}
+
+// 提交队列没有空位或不在事件循环线程上提交失败时返回false
+bool UringEpoller::AddFd(int fd, uint32_t events) {
+    if(fd < 0) return false;
+    std::lock_guard<std::mutex> locker(mtx_);
+    FdState& st = State_(fd);
+    if(st.armed && !PrepRemove_(fd)) { return false; }
+    st.gen++;
+    st.events = events;
+    return PrepPoll_(fd) && FlushForeign_();
+}
+
+bool UringEpoller::ModFd(int fd, uint32_t events) {
+    if(fd < 0) return false;
+    std::lock_guard<std::mutex> locker(mtx_);
+    FdState& st = State_(fd);
+    // 监听事件相同的请求还挂在内核中，不用做任何事
+    if(st.armed && st.events == events && !(events & EPOLLONESHOT)) { return true; }
+    // 还挂着的请求先取消，ONESHOT请求触发后已经结束，直接重新提交即可
+    if(st.armed && !PrepRemove_(fd)) { return false; }
+    st.gen++;
+    st.events = events;
+    return PrepPoll_(fd) && FlushForeign_();
+}
+
+bool UringEpoller::DelFd(int fd) {
+    if(fd < 0) return false;
+    std::lock_guard<std::mutex> locker(mtx_);
+    FdState& st = State_(fd);
+    bool ok = true;
+    if(st.armed) { ok = PrepRemove_(fd) && ok; }
+    // accept和recv请求持有socket的引用，关闭fd并不会结束它们，必须取消
+    if(st.accepting) { ok = PrepCancel_(PackData_(fd, st.ioGen, OP_ACCEPT)) && ok; }
+    if(st.receiving) { ok = PrepCancel_(PackData_(fd, st.ioGen, OP_RECV)) && ok; }
+    if(st.sending) { ok = PrepCancel_(PackData_(fd, st.ioGen, OP_SEND)) && ok; }
+    st.gen++;
+    st.ioGen++;
+    st.armed = st.accepting = st.receiving = st.sending = st.closing = false;
+    return FlushForeign_() && ok;
+}
+
+bool UringEpoller::Accept(int listenFd) {
+    if(listenFd < 0 || !bufRing_) return false;
+    std::lock_guard<std::mutex> locker(mtx_);
+    FdState& st = State_(listenFd);
+    if(st.accepting) { return true; }
+    return PrepAccept_(listenFd) && FlushForeign_();
+}
+
+bool UringEpoller::Recv(int fd) {
+    if(fd < 0 || !bufRing_) return false;
+    std::lock_guard<std::mutex> locker(mtx_);
+    FdState& st = State_(fd);
+    if(st.receiving) { return true; }
+    return PrepRecv_(fd) && FlushForeign_();
+}
+
+bool UringEpoller::Send(int fd, const struct msghdr* msg, int flags) {
+    if(fd < 0 || !bufRing_) return false;
+    std::lock_guard<std::mutex> locker(mtx_);
+    FdState& st = State_(fd);
+    assert(!st.sending);
+    io_uring_sqe* sqe = GetSqe_();
+    if(!sqe) { return false; }
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(msg);
+    sqe->len = 1;
+    sqe->msg_flags = static_cast<uint32_t>(flags) | MSG_NOSIGNAL;
+    sqe->user_data = PackData_(fd, st.ioGen, OP_SEND);
+    st.sending = true;
+    return FlushForeign_();
+}
+
+bool UringEpoller::CancelIo(int fd) {
+    if(fd < 0) return false;
+    std::lock_guard<std::mutex> locker(mtx_);
+    if(static_cast<size_t>(fd) >= states_.size() || !states_[fd].sending) { return false; }
+    FdState& st = states_[fd];
+    // 阻塞在对端窗口上的发送被取消后很快完成，取消失败时也只是等它自然完成
+    if(!st.closing) {
+        PrepCancel_(PackData_(fd, st.ioGen, OP_SEND));
+        FlushForeign_();
+        st.closing = true;
+    }
+    return true;
+}
+
+const Epoller::IoEvent* UringEpoller::GetIoEvent(size_t i) const {
+    assert(i < ioEvents_.size());
+    return ioEvents_[i].kind == IO_NONE ? nullptr : &ioEvents_[i];
+}
+
+int UringEpoller::Wait(int timeoutMs) {
+    loopThread_ = std::this_thread::get_id();
+    unsigned toSubmit = 0;
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        // 上一次交出去的数据已经处理完，缓冲区还给内核之后再重新提交因缺少缓冲区而停止的recv
+        if(bufRing_) { RecycleBufs_(); }
+        while(!rearm_.empty()) {
+            const Rearm& r = rearm_.back();
+            FdState& st = states_[r.fd];
+            if(st.ioGen == r.ioGen && !st.closing) {
+                bool ok = r.op == OP_ACCEPT ? (st.accepting || PrepAccept_(r.fd))
+                                            : (st.receiving || PrepRecv_(r.fd));
+                if(!ok) { break; }
+            }
+            rearm_.pop_back();
+        }
+        int n = Reap_();
+        if(n > 0) {
+            // 已经有事件了，只提交不等待
+            if(Unsubmitted_() > 0) { Enter_(Unsubmitted_(), 0, 0); }
+            return n;
+        }
+        toSubmit = Unsubmitted_();
+    }
+    // 等待时不持锁，线程池仍可以修改监听事件；提交请求和等待事件合并为一次系统调用
+    int ret = Enter_(toSubmit, timeoutMs == 0 ? 0 : 1, timeoutMs);
+    if(ret < 0 && errno != ETIME && errno != EINTR && errno != EBUSY && errno != EAGAIN) {
+        return -1;
+    }
+    std::lock_guard<std::mutex> locker(mtx_);
+    return Reap_();
+}
+
+int UringEpoller::Reap_() {
+    unsigned head = *cqHead_;
+    unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    int n = 0;
+    while(head != tail && static_cast<size_t>(n) < events_.size()) {
+        const io_uring_cqe* cqe = &cqes_[head & *cqMask_];
+        head++;
+        if(cqe->user_data == REMOVE_TAG) { continue; }
+        // 不论事件是否过期，内核取走的缓冲区都要还回去
+        if(cqe->flags & IORING_CQE_F_BUFFER) {
+            usedBufs_.push_back(static_cast<uint16_t>(cqe->flags >> IORING_CQE_BUFFER_SHIFT));
+        }
+        int fd = static_cast<int>(cqe->user_data & 0xffffffff);
+        uint32_t gen = static_cast<uint32_t>(cqe->user_data >> 32) & GEN_MASK;
+        int op = static_cast<int>(cqe->user_data >> 56);
+        if(static_cast<size_t>(fd) >= states_.size()) { continue; }
+        if(op != OP_POLL) {
+            if(ReapIo_(cqe, op, fd, gen, &ioEvents_[n])) {
+                events_[n].data.fd = fd;
+                events_[n].events = 0;
+                n++;
+            }
+            continue;
+        }
+        FdState& st = states_[fd];
+        // 修改或删除之后才到达的旧请求的事件
+        if(gen != (st.gen & GEN_MASK)) { continue; }
+        bool more = cqe->flags & IORING_CQE_F_MORE;
+        if(!more) { st.armed = false; }
+        uint32_t events = static_cast<uint32_t>(cqe->res);
+        if(cqe->res < 0) {
+            if(cqe->res == -ECANCELED) { continue; }
+            // 请求本身失败(如fd已经无效)，报告为错误事件，由调用者关闭
+            events = EPOLLERR;
+        } else if(!more && !(st.events & EPOLLONESHOT) && !PrepPoll_(fd)) {
+            // 水平触发的单次请求，或被内核结束的multishot请求(如完成队列溢出)，重新提交以保持epoll的语义；
+            // 提交不了时同样报告为错误
+            events |= EPOLLERR;
+        }
+        events_[n].data.fd = fd;
+        events_[n].events = events;
+        ioEvents_[n].kind = IO_NONE;
+        n++;
+    }
+    __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+    return n;
+}
+
+bool UringEpoller::ReapIo_(const io_uring_cqe* cqe, int op, int fd, uint32_t gen, IoEvent* ev) {
+    FdState& st = states_[fd];
+    // 连接关闭之后才到达的事件
+    if(gen != (st.ioGen & GEN_MASK)) { return false; }
+    bool more = cqe->flags & IORING_CQE_F_MORE;
+    ev->res = cqe->res;
+    ev->data = nullptr;
+    switch(op) {
+    case OP_ACCEPT:
+        // multishot accept出错时会停止，在下一次Wait中重新提交
+        if(!more) {
+            st.accepting = false;
+            if(cqe->res != -ECANCELED) { rearm_.push_back(Rearm{fd, st.ioGen, OP_ACCEPT}); }
+        }
+        if(cqe->res == -ECANCELED) { return false; }
+        ev->kind = IO_ACCEPT;
+        return true;
+    case OP_RECV:
+        if(!more) {
+            st.receiving = false;
+            // 缓冲区用完，或被内核结束(如完成队列溢出)时重新提交；对端关闭和出错时不再接收
+            if(cqe->res > 0 || cqe->res == -ENOBUFS) { rearm_.push_back(Rearm{fd, st.ioGen, OP_RECV}); }
+        }
+        if(st.closing || cqe->res == -ENOBUFS || cqe->res == -ECANCELED) { return false; }
+        ev->kind = IO_RECV;
+        if(cqe->res > 0) {
+            ev->data = bufs_.get() + static_cast<size_t>(cqe->flags >> IORING_CQE_BUFFER_SHIFT) * BUF_SIZE;
+        }
+        return true;
+    case OP_SEND:
+        st.sending = false;
+        ev->kind = IO_SEND;
+        // 连接正在关闭，不论结果如何都报告为取消，由调用者完成关闭
+        if(st.closing) { ev->res = -ECANCELED; }
+        return true;
+    default:
+        return false;
+    }
+}
@@ -0,0 +1,148 @@
+#ifndef URING_EPOLLER_H
+#define URING_EPOLLER_H
+
+#include <linux/io_uring.h> // io_uring_sqe, io_uring_cqe, io_uring_buf_ring
+#include <sys/syscall.h>    // __NR_io_uring_setup, __NR_io_uring_enter, __NR_io_uring_register
+#include <sys/socket.h>     // msghdr
+#include <sys/mman.h>       // mmap, munmap
+#include <time.h>
+#include <string.h>         // memset
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include "epoller.h"
+
+// 基于io_uring的事件后端，对外接口与Epoller一致
+// 每个被监听的fd在内核中对应一个IORING_OP_POLL_ADD请求，EPOLLET时为multishot，触发后不用重新提交
+// 事件循环线程上的AddFd/ModFd/DelFd只写入提交队列，和下一次Wait合并成一次io_uring_enter系统调用
+// 其他线程(单Reactor模式下的线程池)修改时立即提交，避免事件循环阻塞在等待中而错过
+// 打开完成模式时还可以直接提交accept、recv和send：accept和recv是multishot的，
+// recv的数据放在注册给内核的缓冲区环中，一个请求从接收到发送只需要和Wait合并的那一次系统调用
+class UringEpoller : public Epoller {
+public:
+    // io为true时注册缓冲区环，打开完成模式(需要5.19以上的内核，否则只能用poll请求)
+    explicit UringEpoller(int maxEvent = 1024, bool io = false);
+
+    ~UringEpoller();
+
+    // 环是否创建成功
+    bool IsOpen() const { return ringFd_ >= 0; }
+
+    int Backend() const override { return IO_URING; }
+
+    bool AddFd(int fd, uint32_t events) override;
+
+    bool ModFd(int fd, uint32_t events) override;
+
+    bool DelFd(int fd) override;
+
+    int Wait(int timeoutMs = -1) override;
+
+    // 完成模式只在事件循环线程上使用
+    bool HasIo() const override { return bufRing_ != nullptr; }
+
+    bool Accept(int listenFd) override;
+
+    bool Recv(int fd) override;
+
+    bool Send(int fd, const struct msghdr* msg, int flags) override;
+
+    bool CancelIo(int fd) override;
+
+    const IoEvent* GetIoEvent(size_t i) const override;
+
+private:
+    // 请求的类型，放在user_data的最高字节
+    enum OP {
+        OP_POLL = 0,
+        OP_ACCEPT,
+        OP_RECV,
+        OP_SEND,
+    };
+
+    // 每个fd的请求状态
+    struct FdState {
+        uint32_t events;    // 监听的事件
+        uint32_t gen;       // 代数，每次重新提交poll请求加一，用于丢弃过期的完成事件
+        bool armed;         // 内核中是否还挂着这个fd的poll请求
+        uint32_t ioGen;     // accept、recv、send的代数，DelFd时加一，连接关闭后到达的完成事件直接丢弃
+        bool accepting;     // 还挂着multishot accept
+        bool receiving;     // 还挂着multishot recv
+        bool sending;       // 有发送还没完成，它引用的内存在完成之前不能释放
+        bool closing;       // 已经取消，等发送完成后关闭
+    };
+
+    // 被内核结束、要在下一次Wait中重新提交的multishot请求
+    struct Rearm {
+        int fd;
+        uint32_t ioGen;     // 期间连接关闭时不再提交
+        int op;
+    };
+
+    bool InitRing_(unsigned entries);
+    void UnmapRing_();
+    bool InitBufRing_();        // 注册接收用的缓冲区环
+    void RecycleBufs_();        // 上一次Wait交出去的缓冲区已经用完，还给内核
+
+    io_uring_sqe* GetSqe_();    // 获取一个空闲的提交队列项，队列满了先提交，还是没有空位时返回nullptr
+    bool PrepPoll_(int fd);     // 按当前状态提交poll请求
+    bool PrepRemove_(int fd);   // 取消fd当前的poll请求
+    bool PrepAccept_(int fd);
+    bool PrepRecv_(int fd);
+    bool PrepCancel_(uint64_t data);    // 按user_data取消accept、recv、send
+    bool FlushForeign_();       // 不在事件循环线程上时立即提交
+    unsigned Unsubmitted_() const;      // 已写入提交队列、内核还没取走的请求数
+    int Enter_(unsigned toSubmit, unsigned minComplete, int timeoutMs);
+    int Reap_();                // 收割完成队列，填入events_
+    bool ReapIo_(const io_uring_cqe* cqe, int op, int fd, uint32_t gen, IoEvent* ev);
+    FdState& State_(int fd);
+
+    static uint64_t PackData_(int fd, uint32_t gen, int op = OP_POLL) {
+        return (static_cast<uint64_t>(op) << 56) | (static_cast<uint64_t>(gen & GEN_MASK) << 32) |
+               static_cast<uint32_t>(fd);
+    }
+    static const uint32_t GEN_MASK = 0xffffff;
+    static const uint64_t REMOVE_TAG = ~0ULL;   // 取消请求自身的完成事件，直接忽略
+
+    static const unsigned BUF_NUM = 256;        // 缓冲区个数，必须是2的幂
+    static const unsigned BUF_SIZE = 4096;      // 每个缓冲区的大小
+    static const uint16_t BUF_GROUP = 0;        // 缓冲区组号
+
+    int ringFd_;
+
+    // 提交队列，与内核共享
+    void* sqRing_;
+    size_t sqRingSize_;
+    unsigned* sqHead_;
+    unsigned* sqTail_;
+    unsigned* sqMask_;
+    unsigned* sqArray_;
+    unsigned sqEntries_;
+    io_uring_sqe* sqes_;
+    size_t sqesSize_;
+
+    // 完成队列，与内核共享
+    void* cqRing_;
+    size_t cqRingSize_;
+    unsigned* cqHead_;
+    unsigned* cqTail_;
+    unsigned* cqMask_;
+    io_uring_cqe* cqes_;
+
+    // 接收缓冲区环，与内核共享；内核每次recv取一个缓冲区，完成事件中带着它的编号
+    io_uring_buf_ring* bufRing_;
+    size_t bufRingSize_;
+    std::unique_ptr<char[]> bufs_;
+    uint16_t bufTail_;
+    std::vector<uint16_t> usedBufs_;    // 交给调用者的缓冲区，下一次Wait时归还
+    std::vector<Rearm> rearm_;
+
+    std::vector<IoEvent> ioEvents_;     // 与events_一一对应，poll事件的kind为IO_NONE
+    std::vector<FdState> states_;       // 下标为fd
+    std::mutex mtx_;
+    std::atomic<std::thread::id> loopThread_;   // 调用Wait的线程
+};
+
+#endif //URING_EPOLLER_H
@@ -6,11 +6,14 @@ WebServer::WebServer(
             int port, int trigMode, int timeoutMS, bool OptLinger,
             int sqlPort, const char* sqlUser, const  char* sqlPwd,
             const char* dbName, int connPoolNum, int threadNum,
-            bool openLog, int logLevel, int logQueSize):
-
-            port_(port), openLinger_(OptLinger), timeoutMS_(timeoutMS), isClose_(false),
-            // 新建一个定时器对象，一个线程池对象和一颗epoll树，都以new的形式创建，并返回一个指针
-            timer_(new HeapTimer()), threadpool_(new ThreadPool(threadNum)), epoller_(new Epoller())
+            bool openLog, int logLevel, int logQueSize, int reactorMode, int dispatchMode,
+            int ioBackend, int backlog, int acceptBudget, int queueTargetMs, const char* cpuList,
+            int maxPipeline, int maxHeaderBytes, int maxBodyBytes, int fileCacheMB,
+            int sendfileKB, bool watchFiles):
+
+            maxFd_(GetMaxFd_()), port_(port), openLinger_(OptLinger), timeoutMS_(timeoutMS),
+            backlog_(backlog), acceptBudget_(acceptBudget > 0 ? acceptBudget : 1), isClose_(false),
+            reactorMode_(reactorMode), dispatchMode_(dispatchMode), nextLoop_(0)
 {
     // 以下为构造函数主体部分
     // /home/nowcoder/WebServer-master/
@@ -25,6 +28,20 @@ WebServer::WebServer(
     HttpConn::userCount = 0;
     // 资源文件目录
     HttpConn::srcDir = srcDir_;
+    // 流水线请求一次最多处理的个数，这些响应合并成一次写
+    HttpConn::maxPipeline = std::max(maxPipeline, 1);
+    // 请求大小的上限，超过时在数据收完之前就拒绝，避免无限制地缓存
+    HttpRequest::maxHeaderBytes = std::max(maxHeaderBytes, 1);
+    HttpRequest::maxBodyBytes = std::max(maxBodyBytes, 0);
+    // 静态文件缓存，各连接共享打开的文件和映射；大文件只保持打开，用sendfile发送，不占用映射也不在工作线程里缺页
+    // 每个文件的响应头在加载时生成一次，和文件一起缓存
+    FileCache::Instance()->Init(static_cast<size_t>(std::max(fileCacheMB, 0)) << 20,
+                                sendfileKB > 0 ? static_cast<size_t>(sendfileKB) << 10: SIZE_MAX,
+                                HttpResponse::FileHeader);
+    // 4xx响应整个预先生成，不再每次查找和拼接错误页面
+    HttpResponse::LoadErrorPages(srcDir_);
+    // 监视资源目录，文件被覆盖、删除后缓存中的条目自动失效；不缓存时每次都重新打开，不需要监视
+    bool watching = watchFiles && fileCacheMB > 0 && watcher_.Start(srcDir_);
 
     // 初始化数据库连接池
     // Instance()得到一个SqlConnPool一个实例化对象，为静态局部变量
@@ -34,14 +51,88 @@ WebServer::WebServer(
     // 初始化事件的模式，一般为边缘触发
     InitEventMode_(trigMode);
 
+    // 绑核：CPU列表依次分给各事件循环、线程池线程和日志线程
+    bool cpuListOk = ParseCpuList_(cpuList, &cpus_);
+    cpu_set_t origMask;
+    bool pinMain = !cpus_.empty() && pthread_getaffinity_np(pthread_self(), sizeof(origMask), &origMask) == 0;
+    if(!pinMain) { cpus_.clear(); }
+    size_t nextCpu = 0;
+
+    // 单Reactor模式：一个事件循环 + 线程池
+    // 多Reactor模式：threadNum个事件循环，每个循环都有自己的epoll树、定时器和监听套接字
+    // 主从Reactor模式：1个主Reactor + threadNum个从Reactor，只有主Reactor持有监听套接字
+    int loopNum = 1;
+    if(reactorMode_ == MULTI_REACTOR) {
+        assert(threadNum > 0);
+        loopNum = threadNum;
+    } else if(reactorMode_ == MAIN_SUB_REACTOR) {
+        assert(threadNum > 0);
+        loopNum = threadNum + 1;
+    }
+    for(int i = 0; i < loopNum; i++) {
+        // 新建一个定时器对象和一颗epoll树，都以new的形式创建
+        std::unique_ptr<EventLoop> loop(new EventLoop);
+        loop->id = i;
+        loop->cpu = cpus_.empty() ? -1 : cpus_[nextCpu++ % cpus_.size()];
+        // 先把当前线程临时绑到该循环的CPU上再分配它的epoll、定时器和连接槽，
+        // 按first-touch策略这些内存落在该CPU所在的NUMA节点上
+        if(loop->cpu >= 0) { PinThread_(loop->cpu); }
+        loop->listenFd = -1;
+        loop->wakeupFd = -1;
+        loop->connCount = 0;
+        loop->accepted = 0;
+        loop->rejected = 0;
+        loop->shed = 0;
+        loop->acceptPending = false;
+        // 连接由事件循环线程自己读写时，io_uring直接完成accept、接收和发送
+        loop->epoller.reset(Epoller::Create(ioBackend, 1024, maxFd_, reactorMode_ != SINGLE_REACTOR));
+        loop->timer.reset(new HeapTimer());
+        loop->users.resize(maxFd_);
+        if(reactorMode_ == MAIN_SUB_REACTOR && i > 0) {
+            // 从Reactor通过eventfd被主Reactor唤醒
+            loop->wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if(loop->wakeupFd < 0 || !loop->epoller->AddFd(loop->wakeupFd, EPOLLIN)) {
+                isClose_ = true;
+            }
+        }
+        loops_.push_back(std::move(loop));
+    }
+    if(reactorMode_ == SINGLE_REACTOR) {
+        std::vector<int> workerCpus;
+        for(int i = 0; i < threadNum && !cpus_.empty(); i++) {
+            workerCpus.push_back(cpus_[nextCpu++ % cpus_.size()]);
+        }
+        // 任务在队列中排队太久说明线程池处理不过来，由WebServer据此拒绝新请求
+        threadpool_.reset(new ThreadPool(threadNum, queueTargetMs, 100, workerCpus));
+    }
+
+    // 过载时的响应只生成一次
+    const char* busyBody = "<html><title>Error</title><body bgcolor=\"ffffff\">503 : Service Unavailable\n"
+                           "<p>Server busy, please retry later.</p><hr><em>TinyWebServer</em></body></html>";
+    char busyHead[256] = { 0 };
+    snprintf(busyHead, sizeof(busyHead), "HTTP/1.1 503 Service Unavailable\r\nRetry-After: %d\r\n"
+             "Connection: close\r\nContent-type: text/html\r\nContent-length: %zu\r\n\r\n",
+             RETRY_AFTER_S, strlen(busyBody));
+    busyResponse_ = std::string(busyHead) + busyBody;
+
     // 初始化网络通信相关的一些内容, isClose为关闭状态
-    // 创建监听套接字，可能创建失败
-    if(!InitSocket_()) { isClose_ = true;}
+    // 创建监听套接字，可能创建失败，主从模式下只有主Reactor需要
+    for(auto& loop: loops_) {
+        if(reactorMode_ == MAIN_SUB_REACTOR && loop->id > 0) { break; }
+        if(!InitSocket_(loop.get())) { isClose_ = true; break; }
+    }
+    // 所有监听套接字都已加入同一个SO_REUSEPORT组，按收包CPU把新连接交给绑在该CPU上的事件循环
+    bool cpuFilter = false;
+    if(reactorMode_ == MULTI_REACTOR && !cpus_.empty() && !isClose_) {
+        cpuFilter = AttachCpuFilter_();
+    }
 
     // 引入日志模板功能，先不看
     if(openLog) {
         // 初始化日志信息
         // 日志系统使用的也是单例模式，logLevel = 1， logQueSize = 1024，如果logQueSize为0，则为同步日志系统
+        // 异步写日志的线程在init中创建，继承当前线程的CPU亲和性
+        if(!cpus_.empty()) { PinThread_(cpus_[nextCpu++ % cpus_.size()]); }
         Log::Instance()->init(logLevel, "./log", ".log", logQueSize);
         if(isClose_) { LOG_ERROR("========== Server init error!=========="); }
         else {
@@ -50,17 +141,58 @@ WebServer::WebServer(
             LOG_INFO("Listen Mode: %s, OpenConn Mode: %s",
                             (listenEvent_ & EPOLLET ? "ET": "LT"),
                             (connEvent_ & EPOLLET ? "ET": "LT"));
+            int backend = loops_[0]->epoller->Backend();
+            LOG_INFO("IO Backend: %s", (backend != Epoller::IO_URING ? "epoll":
+                                        loops_[0]->epoller->HasIo() ? "io_uring(accept/recv/send)": "io_uring(poll)"));
+            if(backend != ioBackend) { LOG_WARN("io_uring unavailable, fall back to epoll"); }
             LOG_INFO("LogSys level: %d", logLevel);
+            LOG_INFO("Http scan: %s", HttpScan::Backend());
             LOG_INFO("srcDir: %s", HttpConn::srcDir);
-            LOG_INFO("SqlConnPool num: %d, ThreadPool num: %d", connPoolNum, threadNum);
+            LOG_INFO("Reactor Mode: %s, EventLoop num: %d",
+                            (reactorMode_ == MULTI_REACTOR ? "multi":
+                             reactorMode_ == MAIN_SUB_REACTOR ? "main-sub": "single"), (int)loops_.size());
+            if(reactorMode_ == MAIN_SUB_REACTOR) {
+                LOG_INFO("Dispatch Mode: %s", (dispatchMode_ == LEAST_LOADED ? "least-loaded":
+                                               dispatchMode_ == INCOMING_CPU ? "incoming-cpu": "round-robin"));
+            }
+            LOG_INFO("Max fd: %d, Listen backlog: %d, Accept budget: %d", maxFd_, backlog_, acceptBudget_);
+            LOG_INFO("Max pipeline: %d, Max header: %zu bytes, Max body: %zu bytes", HttpConn::maxPipeline,
+                            HttpRequest::maxHeaderBytes, HttpRequest::maxBodyBytes);
+            LOG_INFO("File cache: %dMB, inline files up to %zu bytes", std::max(fileCacheMB, 0), FileCache::INLINE_MAX);
+            if(sendfileKB > 0) { LOG_INFO("Sendfile files over %dKB", sendfileKB); }
+            LOG_INFO("File watcher: %s", (watching ? "inotify": "off"));
+            if(watchFiles && fileCacheMB > 0 && !watching) {
+                LOG_WARN("File watcher start failed, changed files need a restart");
+            }
+            LOG_INFO("SqlConnPool num: %d, ThreadPool num: %d", connPoolNum,
+                            (threadpool_ ? threadNum: 0));
+            if(threadpool_ && queueTargetMs > 0) {
+                LOG_INFO("Overload control: queue target %dms", queueTargetMs);
+            }
+            if(!cpuListOk) { LOG_WARN("Invalid cpu list: %s, threads not pinned", cpuList); }
+            for(auto& loop: loops_) {
+                if(loop->cpu >= 0) { LOG_INFO("Loop[%d] pinned to cpu %d", loop->id, loop->cpu); }
+            }
+            if(reactorMode_ == MULTI_REACTOR && !cpus_.empty()) {
+                LOG_INFO("Reuseport cpu steering: %s", cpuFilter ? "on": "off");
+            }
         }
     }
+    // 恢复构造线程原来的CPU亲和性，0号循环在Loop_中再绑定
+    if(pinMain) { pthread_setaffinity_np(pthread_self(), sizeof(origMask), &origMask); }
 }
 
 // 析构函数，当程序结束时，做一些清除工作
 WebServer::~WebServer() {
-    close(listenFd_);
     isClose_ = true;
+    for(auto& t: loopThreads_) {
+        if(t.joinable()) { t.join(); }
+    }
+    for(auto& loop: loops_) {
+        if(loop->listenFd >= 0) { close(loop->listenFd); }
+        if(loop->wakeupFd >= 0) { close(loop->wakeupFd); }
+    }
+    watcher_.Stop();
     // 这句啥意思
     free(srcDir_);
     SqlConnPool::Instance()->ClosePool();
@@ -90,57 +222,107 @@ void WebServer::InitEventMode_(int trigMode) {
         connEvent_ |= EPOLLET;
         break;
     }
+    // 连接只被一个事件循环线程处理时不需要EPOLLONESHOT，监听事件不变就不必每次重新设置
+    if(reactorMode_ != SINGLE_REACTOR) {
+        connEvent_ &= ~EPOLLONESHOT;
+    }
     // 是否ET模式标志位
     HttpConn::isET = (connEvent_ & EPOLLET);
 }
 
 // 启动服务器
 void WebServer::Start() {
-    int timeMS = -1;  /* epoll wait timeout == -1 无事件将阻塞 */
     if(!isClose_) { LOG_INFO("========== Server start =========="); }
+    // 多Reactor和主从Reactor模式下，1号及以后的事件循环各自运行在独立线程上，0号循环由当前线程驱动
+    for(size_t i = 1; i < loops_.size(); i++) {
+        loopThreads_.emplace_back(&WebServer::Loop_, this, loops_[i].get());
+    }
+    Loop_(loops_[0].get());
+    for(auto& t: loopThreads_) {
+        if(t.joinable()) { t.join(); }
+    }
+}
+
+// 运行一个事件循环
+void WebServer::Loop_(EventLoop* loop) {
+    if(loop->cpu >= 0 && !PinThread_(loop->cpu)) {
+        LOG_WARN("Pin loop[%d] to cpu %d error!", loop->id, loop->cpu);
+    }
+    // 主从模式下主Reactor没有连接，不需要检查超时
+    bool isMainReactor = (reactorMode_ == MAIN_SUB_REACTOR && loop->id == 0);
+    // 0号事件循环定时打印各循环的统计信息
+    TimeStamp nextStats = Clock::now() + MS(STATS_INTERVAL_MS);
     // 只要没关闭就一直循环
     while(!isClose_) {
+        // 每一轮重新计算，上一轮的0(统计到期或有积压的连接)不能留到下一轮，否则会空转
+        int timeMS = -1;  /* epoll wait timeout == -1 无事件将阻塞 */
+
+        // 上一轮accept预算用完了，在处理完已建立连接的事件之后继续accept
+        if(loop->acceptPending) {
+            DealListen_(loop);
+        }
 
         // 如果设置了超时时间，例如60s,则只要一个连接60秒没有读写操作，则关闭
-        if(timeoutMS_ > 0) {
+        if(!isMainReactor && timeoutMS_ > 0) {
             // 通过定时器GetNextTick(),清除超时的节点，然后获取最先要超时的连接的超时的时间
-            timeMS = timer_->GetNextTick();
+            timeMS = loop->timer->GetNextTick();
+        }
+        if(loop->id == 0) {
+            if(Clock::now() >= nextStats) {
+                LogLoopStats_();
+                nextStats = Clock::now() + MS(STATS_INTERVAL_MS);
+            }
+            int statsMS = std::max<int>(0, std::chrono::duration_cast<MS>(nextStats - Clock::now()).count());
+            if(timeMS < 0 || statsMS < timeMS) { timeMS = statsMS; }
         }
+        // 还有积压的连接，不阻塞
+        if(loop->acceptPending) { timeMS = 0; }
 
         // timeMS是最先要超时的连接的超时的时间，传递到epoll_wait()函数中
         // 当timeMS时间内有事件发生，epoll_wait()返回，否则等到了timeMS时间后才返回
         // 这样做的目的是为了让epoll_wait()调用次数变少，提高效率
-        int eventCnt = epoller_->Wait(timeMS);
+        int eventCnt = loop->epoller->Wait(timeMS);
 
         // 循环处理每一个事件
         for(int i = 0; i < eventCnt; i++) {
             /* 处理事件 */
             // 不是直接访问数据，而是通过封装的形式，体现了面向对象编程的特点
-            int fd = epoller_->GetEventFd(i);   // 获取事件对应的fd
-            uint32_t events = epoller_->GetEvents(i);   // 获取事件的类型
+            int fd = loop->epoller->GetEventFd(i);   // 获取事件对应的fd
+            uint32_t events = loop->epoller->GetEvents(i);   // 获取事件的类型
+            const Epoller::IoEvent* io = loop->epoller->GetIoEvent(i);
+
+            // 完成模式下后端已经做完的accept、接收和发送
+            if(io) {
+                DealIo_(loop, fd, *io);
+            }
 
             // 监听的文件描述符有事件，说明有新的连接进来
-            if(fd == listenFd_) {
-                DealListen_();  // 处理监听的操作，接受客户端连接
+            else if(fd == loop->listenFd) {
+                DealListen_(loop);  // 处理监听的操作，接受客户端连接
+
+            }
 
+            // 主Reactor交来了新的连接
+            else if(fd == loop->wakeupFd) {
+                DealWakeup_(loop);
             }
 
             // 错误的一些情况
             else if(events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
-                assert(users_.count(fd) > 0);
-                CloseConn_(&users_[fd]);    // 关闭连接
+                assert(fd < maxFd_ && loop->users[fd]);
+                CloseConn_(loop, loop->users[fd].get());    // 关闭连接
             }
 
             // 有数据到达
             else if(events & EPOLLIN) {
-                assert(users_.count(fd) > 0);
-                DealRead_(&users_[fd]); // 处理读操作
+                assert(fd < maxFd_ && loop->users[fd]);
+                DealRead_(loop, loop->users[fd].get()); // 处理读操作
             }
 
             // 可以发送数据
             else if(events & EPOLLOUT) {
-                assert(users_.count(fd) > 0);
-                DealWrite_(&users_[fd]);    // 处理写操作
+                assert(fd < maxFd_ && loop->users[fd]);
+                DealWrite_(loop, loop->users[fd].get());    // 处理写操作
             } else {
                 LOG_ERROR("Unexpected event");
             }
@@ -151,113 +333,296 @@ void WebServer::Start() {
 // 发送错误提示信息
 void WebServer::SendError_(int fd, const char*info) {
     assert(fd > 0);
-    int ret = send(fd, info, strlen(info), 0);
+    int ret = send(fd, info, strlen(info), MSG_NOSIGNAL);
     if(ret < 0) {
         LOG_WARN("send error to client[%d] error!", fd);
     }
     close(fd);
 }
 
+// 过载时拒绝连接上的新请求：先把请求读掉(避免带着未读数据close导致RST，客户端收不到响应)，
+// 再直接发送预先生成的503响应并关闭连接
+void WebServer::ShedConn_(EventLoop* loop, HttpConn* client) {
+    assert(client);
+    int readErrno = 0;
+    client->read(&readErrno);
+    int ret = send(client->GetFd(), busyResponse_.data(), busyResponse_.size(), MSG_NOSIGNAL);
+    if(ret < 0) {
+        LOG_WARN("send error to client[%d] error!", client->GetFd());
+    }
+    loop->shed++;
+    CloseConn_(loop, client);
+}
+
 // 关闭连接（从epoll中删除，解除响应对象中的内存映射，用户数递减，关闭文件描述符）
-void WebServer::CloseConn_(HttpConn* client) {
+void WebServer::CloseConn_(EventLoop* loop, HttpConn* client) {
     assert(client);
+    // 完成模式下还有发送没有结束，它引用着响应的数据；取消之后在它的结果中再关闭
+    if(!client->IsClose() && loop->epoller->CancelIo(client->GetFd())) { return; }
     LOG_INFO("Client[%d] quit!", client->GetFd());
-    epoller_->DelFd(client->GetFd());
+    if(!client->IsClose()) { loop->connCount--; }
+    loop->epoller->DelFd(client->GetFd());
     client->Close();
 }
 
 // 添加客户端
-void WebServer::AddClient_(int fd, sockaddr_in addr) {
+void WebServer::AddClient_(EventLoop* loop, int fd, sockaddr_in addr) {
     assert(fd > 0);
     // fd为新的socket文件描述符，用于和客户端通信
     // 每连接一个，就创建一个HttpConn类对象，并进行初始化
-    users_[fd].init(fd, addr);
+    HttpConn* client = GetConn_(loop, fd);
+    client->init(fd, addr);
+    // 完成模式下直接开始接收，否则添加到epoll中进行管理，fd在accept4时已经设置为非阻塞
+    bool added = loop->epoller->HasIo() ? loop->epoller->Recv(fd): loop->epoller->AddFd(fd, EPOLLIN | connEvent_);
+    if(!added) {
+        // 监听不上的连接永远不会有事件，立即关闭
+        LOG_ERROR("Add client[%d] error!", fd);
+        CloseConn_(loop, client);
+        return;
+    }
     // 判断是否开启超时
     if(timeoutMS_ > 0) {
         // 添加到定时器对象中，当检测到超时时执行CloseConn_函数进行关闭连接
-        timer_->add(fd, timeoutMS_, std::bind(&WebServer::CloseConn_, this, &users_[fd]));
+        loop->timer->add(fd, timeoutMS_, std::bind(&WebServer::CloseConn_, this, loop, client));
     }
-    // 添加到epoll中进行管理
-    epoller_->AddFd(fd, EPOLLIN | connEvent_);
-    // 设置文件描述符非阻塞
-    SetFdNonblock(fd);
-    LOG_INFO("Client[%d] in!", users_[fd].GetFd());
+    LOG_INFO("Client[%d] in loop[%d]!", client->GetFd(), loop->id);
+}
+
+// 取fd对应的连接槽，第一次使用时才分配，在拥有这个连接的线程上分配
+HttpConn* WebServer::GetConn_(EventLoop* loop, int fd) {
+    assert(fd >= 0 && fd < maxFd_);
+    if(!loop->users[fd]) {
+        loop->users[fd].reset(new HttpConn());
+    }
+    return loop->users[fd].get();
 }
 
 // 处理监听
-void WebServer::DealListen_() {
+void WebServer::DealListen_(EventLoop* loop) {
     struct sockaddr_in addr; // 保存连接的客户端的信息
-    socklen_t len = sizeof(addr);
-    // 如果监听文件描述符设置的是 ET模式，则需要循环把所有连接处理了
-    // 循环把所有连接都处理了
-    do {
-        // 从已完成连接队列提取新的连接
-        int fd = accept(listenFd_, (struct sockaddr *)&addr, &len);
+    socklen_t len;
+    loop->acceptPending = false;
+    // 一次最多accept acceptBudget_个连接；ET模式下预算用完时监听队列可能还没取空，
+    // 不会再有新的通知，由Loop_在处理完本轮其他事件后继续；LT模式下内核会再次通知
+    for(int n = 0; n < acceptBudget_; n++) {
+        len = sizeof(addr);
+        // 从已完成连接队列提取新的连接，同时设置非阻塞和close-on-exec，省去一次fcntl
+        int fd = accept4(loop->listenFd, (struct sockaddr *)&addr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
         // 已经设置了监听套接字为非阻塞模式了，若提取不到连接了，就会返回
-        if(fd <= 0) { return;}
+        if(fd < 0) {
+            if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED) {
+                // EMFILE/ENFILE等，连接仍留在监听队列里
+                loop->rejected++;
+                LOG_WARN("Accept error: %s", strerror(errno));
+            }
+            return;
+        }
+        AcceptClient_(loop, fd, addr);
+    }
+    if(listenEvent_ & EPOLLET) { loop->acceptPending = true; }
+}
 
-        // 判断是否超过最大连接数
-        else if(HttpConn::userCount >= MAX_FD) {
-            SendError_(fd, "Server busy!");
-            LOG_WARN("Clients is full!");
+// 接纳一个新连接，连接数已满或过载时直接拒绝
+void WebServer::AcceptClient_(EventLoop* loop, int fd, sockaddr_in addr) {
+    // 判断是否超过最大连接数
+    if(HttpConn::userCount >= maxFd_ || fd >= maxFd_) {
+        loop->rejected++;
+        SendError_(fd, busyResponse_.c_str());
+        LOG_WARN("Clients is full!");
+        return;
+    }
+    // 线程池过载，新连接直接拒绝，不再让它们排队拖慢已接纳的请求
+    if(threadpool_ && threadpool_->IsOverloaded()) {
+        loop->rejected++;
+        SendError_(fd, busyResponse_.c_str());
+        LOG_WARN("Server overloaded, reject client[%d]!", fd);
+        return;
+    }
+    loop->accepted++;
+    if(reactorMode_ == MAIN_SUB_REACTOR) {
+        Dispatch_(fd, addr);    // 交给从Reactor
+    } else {
+        loop->connCount++;
+        AddClient_(loop, fd, addr);   // 添加客户端
+    }
+}
+
+// 完成模式下后端交来的结果：listenFd上的新连接，连接上收到的数据和发送完成的字节数
+void WebServer::DealIo_(EventLoop* loop, int fd, const Epoller::IoEvent& io) {
+    if(io.kind == Epoller::IO_ACCEPT) {
+        if(io.res < 0) {
+            if(io.res != -EAGAIN && io.res != -EINTR && io.res != -ECONNABORTED) {
+                loop->rejected++;
+                LOG_WARN("Accept error: %s", strerror(-io.res));
+            }
             return;
         }
-        AddClient_(fd, addr);   // 添加客户端
-    } while(listenEvent_ & EPOLLET);
+        // multishot accept不带回对端地址
+        struct sockaddr_in addr = { 0 };
+        socklen_t len = sizeof(addr);
+        getpeername(io.res, (struct sockaddr *)&addr, &len);
+        AcceptClient_(loop, io.res, addr);
+        return;
+    }
+    assert(fd < maxFd_ && loop->users[fd]);
+    HttpConn* client = loop->users[fd].get();
+    if(io.res <= 0) {
+        // 对端关闭或出错
+        CloseConn_(loop, client);
+        return;
+    }
+    if(io.kind == Epoller::IO_RECV) {
+        ExtentTime_(loop, client);
+        client->Receive(io.data, io.res);
+        // 上一批响应还没发完，发完之后再处理新的请求
+        if(client->ToWriteBytes() == 0) { OnProcess(loop, client); }
+    } else {
+        client->HasSent(io.res);
+        OnSend_(loop, client);
+    }
+}
+
+// 主Reactor选择一个从Reactor，把新连接放入其待处理队列并通过eventfd唤醒它
+void WebServer::Dispatch_(int fd, sockaddr_in addr) {
+    assert(loops_.size() > 1);
+    EventLoop* sub = nullptr;
+    if(dispatchMode_ == LEAST_LOADED) {
+        for(size_t i = 1; i < loops_.size(); i++) {
+            if(!sub || loops_[i]->connCount < sub->connCount) { sub = loops_[i].get(); }
+        }
+    } else if(dispatchMode_ == INCOMING_CPU) {
+        // 内核记录了处理这个连接报文的CPU，交给绑在同一CPU上的从Reactor，避免跨核/跨NUMA节点访问
+        int cpu = -1;
+        socklen_t len = sizeof(cpu);
+        if(getsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) == 0) {
+            for(size_t i = 1; i < loops_.size(); i++) {
+                if(loops_[i]->cpu == cpu) { sub = loops_[i].get(); break; }
+            }
+        }
+    }
+    if(!sub) {
+        sub = loops_[1 + nextLoop_].get();
+        nextLoop_ = (nextLoop_ + 1) % (loops_.size() - 1);
+    }
+    // 在主Reactor中计数，最少连接策略才能立刻看到刚分发出去的连接
+    sub->connCount++;
+    {
+        std::lock_guard<std::mutex> locker(sub->mtx);
+        sub->pending.emplace_back(fd, addr);
+    }
+    uint64_t one = 1;
+    if(::write(sub->wakeupFd, &one, sizeof(one)) != sizeof(one)) {
+        LOG_WARN("Wakeup loop[%d] error!", sub->id);
+    }
+    LOG_DEBUG("Client[%d] dispatch to loop[%d], conns:%d", fd, sub->id, (int)sub->connCount);
+}
+
+// 从Reactor取出主Reactor交来的所有连接并加入自己的epoll
+void WebServer::DealWakeup_(EventLoop* loop) {
+    uint64_t cnt = 0;
+    if(::read(loop->wakeupFd, &cnt, sizeof(cnt)) < 0 && errno != EAGAIN) {
+        LOG_WARN("Read wakeup of loop[%d] error!", loop->id);
+    }
+    std::vector<std::pair<int, sockaddr_in>> pending;
+    {
+        std::lock_guard<std::mutex> locker(loop->mtx);
+        pending.swap(loop->pending);
+    }
+    for(auto& item: pending) {
+        AddClient_(loop, item.first, item.second);
+    }
+}
+
+// 打印各事件循环的连接数和accept计数，用于观察负载是否均衡
+// 主从模式下accept都发生在0号主Reactor上，连接数分布在各从Reactor上
+void WebServer::LogLoopStats_() {
+    for(auto& loop: loops_) {
+        LOG_INFO("Loop[%d] conns:%d, accepted:%llu, rejected:%llu, shed:%llu", loop->id, (int)loop->connCount,
+                 (unsigned long long)loop->accepted, (unsigned long long)loop->rejected,
+                 (unsigned long long)loop->shed);
+    }
 }
 
 // 处理读
-void WebServer::DealRead_(HttpConn* client) {
+void WebServer::DealRead_(EventLoop* loop, HttpConn* client) {
     assert(client);
-    ExtentTime_(client);   // 延长这个客户端的超时时间
+    if(reactorMode_ != SINGLE_REACTOR) {
+        ExtentTime_(loop, client);   // 延长这个客户端的超时时间
+        // 连接只属于当前事件循环，直接在本线程读取并处理，省去线程池的加锁和唤醒
+        OnRead_(loop, client);
+        return;
+    }
+    // 线程池过载时新请求不再入队，立即返回503
+    if(threadpool_->IsOverloaded()) {
+        ShedConn_(loop, client);
+        return;
+    }
+    ExtentTime_(loop, client);   // 延长这个客户端的超时时间
     // 加入到队列中等待线程池中的线程处理（读取数据）
-    threadpool_->AddTask(std::bind(&WebServer::OnRead_, this, client));
+    // 单Reactor只有一个事件循环，任务只捕获两个指针，std::function直接存放，不分配内存
+    assert(loop == loops_[0].get());
+    threadpool_->AddTask([this, client] { OnRead_(loops_[0].get(), client); });
 }
 
 // 处理写
-void WebServer::DealWrite_(HttpConn* client) {
+void WebServer::DealWrite_(EventLoop* loop, HttpConn* client) {
     assert(client);
-    ExtentTime_(client);// 延长这个客户端的超时时间
+    ExtentTime_(loop, client);// 延长这个客户端的超时时间
+    if(reactorMode_ != SINGLE_REACTOR) {
+        OnWrite_(loop, client);
+        return;
+    }
     // 加入到队列中等待线程池中的线程处理（写数据）
-    threadpool_->AddTask(std::bind(&WebServer::OnWrite_, this, client));
+    assert(loop == loops_[0].get());
+    threadpool_->AddTask([this, client] { OnWrite_(loops_[0].get(), client); });
 }
 
 // 延长客户端的超时时间
-void WebServer::ExtentTime_(HttpConn* client) {
+void WebServer::ExtentTime_(EventLoop* loop, HttpConn* client) {
     assert(client);
-    if(timeoutMS_ > 0) { timer_->adjust(client->GetFd(), timeoutMS_); }
+    if(timeoutMS_ > 0) { loop->timer->adjust(client->GetFd(), timeoutMS_); }
 }
 
-// 这个方法是在子线程中执行的（读取数据）
-void WebServer::OnRead_(HttpConn* client) {
+// 单Reactor模式下在子线程中执行，其余模式下在事件循环线程中执行（读取数据）
+void WebServer::OnRead_(EventLoop* loop, HttpConn* client) {
     assert(client);
     int ret = -1;
     int readErrno = 0;
     ret = client->read(&readErrno); // 读取客户端的数据，已经将数据放在读缓冲区了
     // EAGAIN提示没有数据可读，请稍后再试
     if(ret <= 0 && readErrno != EAGAIN) {
-        CloseConn_(client);
+        CloseConn_(loop, client);
         return;
     }
 
     // 业务逻辑的处理
-    OnProcess(client);
+    OnProcess(loop, client);
 }
 
 // 业务逻辑的处理
-void WebServer::OnProcess(HttpConn* client) {
+void WebServer::OnProcess(EventLoop* loop, HttpConn* client) {
     if(client->process()) {
+        if(reactorMode_ != SINGLE_REACTOR) {
+            // 在事件循环线程上直接尝试写，写不完(EAGAIN)才去监听EPOLLOUT
+            OnWrite_(loop, client);
+            return;
+        }
         // 将文件描述符可写加入监听
-        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT);    
+        if(!loop->epoller->ModFd(client->GetFd(), connEvent_ | EPOLLOUT)) { CloseConn_(loop, client); }
         // 重置事件以确保这个 socket 下一次可读时，其 EPOLLIN 事件能被触发，进而让其他工作线程有机会继续处理这个 socket。
-    } else {
-        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLIN);
+    } else if(!loop->epoller->HasIo()) {
+        // 完成模式下一直在接收，不用重新监听
+        if(!loop->epoller->ModFd(client->GetFd(), connEvent_ | EPOLLIN)) { CloseConn_(loop, client); }
     }
 }
 
 // 写数据
-void WebServer::OnWrite_(HttpConn* client) {
+void WebServer::OnWrite_(EventLoop* loop, HttpConn* client) {
     assert(client);
+    if(loop->epoller->HasIo()) {
+        OnSend_(loop, client);
+        return;
+    }
     int ret = -1;
     int writeErrno = 0;
     ret = client->write(&writeErrno);   // 写数据
@@ -266,22 +631,51 @@ void WebServer::OnWrite_(HttpConn* client) {
     if(client->ToWriteBytes() == 0) {
         /* 传输完成 */
         if(client->IsKeepAlive()) {
-            OnProcess(client);
+            OnProcess(loop, client);
             return;
         }
     }
     else if(ret < 0) {
         if(writeErrno == EAGAIN) {
             /* 继续传输 */
-            epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT);
+            if(loop->epoller->ModFd(client->GetFd(), connEvent_ | EPOLLOUT)) { return; }
+        }
+    }
+    CloseConn_(loop, client);
+}
+
+// 完成模式下的写：内存中的数据交给后端发送，结果在DealIo_中处理后再回到这里；
+// sendfile的文件仍在本线程直接发送，套接字缓冲区满时等一次可写
+void WebServer::OnSend_(EventLoop* loop, HttpConn* client) {
+    assert(client);
+    int fd = client->GetFd();
+    while(client->ToWriteBytes() > 0) {
+        int flags = 0;
+        const struct msghdr* msg = client->NextMsg(&flags);
+        if(msg) {
+            if(!loop->epoller->Send(fd, msg, flags)) {
+                LOG_ERROR("Send to client[%d] error!", fd);
+                CloseConn_(loop, client);
+            }
+            return;
+        }
+        int writeErrno = 0;
+        if(client->SendFile(&writeErrno) <= 0) {
+            if(writeErrno == EAGAIN && loop->epoller->ModFd(fd, EPOLLOUT | EPOLLONESHOT)) { return; }
+            CloseConn_(loop, client);
             return;
         }
     }
-    CloseConn_(client);
+    /* 传输完成 */
+    if(client->IsKeepAlive()) {
+        OnProcess(loop, client);
+        return;
+    }
+    CloseConn_(loop, client);
 }
 
 /* Create listenFd */
-bool WebServer::InitSocket_() {
+bool WebServer::InitSocket_(EventLoop* loop) {
     int ret;
     // 定义Socket结构体
     struct sockaddr_in addr;
@@ -295,71 +689,146 @@ bool WebServer::InitSocket_() {
     // 由于绑定了统配地址，就不需要用inet_pton()将点分十进制串转化为32位网络大端的数据
     addr.sin_port = htons(port_); // 端口号转网络大端数据流
 
-    // 这个优雅开关是干嘛的
-    struct linger optLinger = { 0 };
-
-    // 打开优雅关闭
-    if(openLinger_) {
-        /* 优雅关闭: 直到所剩数据发送完毕或超时 */
-        optLinger.l_onoff = 1;
-        optLinger.l_linger = 1;
-    }
-
-    // 创建监听套接字，listenFd_已在WebServer的私有成员中定义好
-    listenFd_ = socket(AF_INET, SOCK_STREAM, 0);
+    // 创建监听套接字，每个事件循环各有一个；直接设置为非阻塞模式
+    int listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     // 判断是否创建成功
-    if(listenFd_ < 0) {
+    if(listenFd < 0) {
         LOG_ERROR("Create socket error!", port_);
         return false;
     }
 
-    // 对监听套接字做一些相关设置，涉及到优雅关闭
-    ret = setsockopt(listenFd_, SOL_SOCKET, SO_LINGER, &optLinger, sizeof(optLinger));
-    if(ret < 0) {
-        close(listenFd_);
+    // 对监听套接字做一些相关设置，涉及到优雅关闭，打开时直到所剩数据发送完毕或超时
+    if(!SockOpt::SetLinger(listenFd, openLinger_)) {
+        close(listenFd);
         LOG_ERROR("Init linger error!", port_);
         return false;
     }
 
-    int optval = 1;
     /* 端口复用 */
     /* 只有最后一个套接字会正常接收数据。 */
-    ret = setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, (const void*)&optval, sizeof(int));
-    if(ret == -1) {
+    if(!SockOpt::SetReuseAddr(listenFd)) {
         LOG_ERROR("set socket setsockopt error !");
-        close(listenFd_);
+        close(listenFd);
         return false;
     }
+    if(reactorMode_ == MULTI_REACTOR) {
+        /* 多Reactor模式下每个事件循环都绑定同一端口，由内核在这些监听套接字之间分发新连接 */
+        if(!SockOpt::SetReusePort(listenFd)) {
+            LOG_ERROR("set socket SO_REUSEPORT error !");
+            close(listenFd);
+            return false;
+        }
+    }
+
+    // 以下选项只影响性能，内核不支持时照常运行
+    // 连接继承监听套接字的TCP_NODELAY，省去每个连接一次setsockopt
+    if(!SockOpt::SetNoDelay(listenFd)) {
+        LOG_WARN("set socket TCP_NODELAY error: %s", strerror(errno));
+    }
+    // 客户端发来请求后才通知accept，新连接加入epoll后第一次读就能读到数据
+    if(DEFER_ACCEPT_S > 0 && !SockOpt::SetDeferAccept(listenFd, DEFER_ACCEPT_S)) {
+        LOG_WARN("set socket TCP_DEFER_ACCEPT error: %s", strerror(errno));
+    }
+    // 还需要net.ipv4.tcp_fastopen打开服务端支持(值包含2)才会生效
+    if(FASTOPEN_QLEN > 0 && !SockOpt::SetFastOpen(listenFd, FASTOPEN_QLEN)) {
+        LOG_WARN("set socket TCP_FASTOPEN error: %s", strerror(errno));
+    }
     // 绑定ip和端口到套接字，需要转换为通用套接字结构体类型
-    ret = bind(listenFd_, (struct sockaddr *)&addr, sizeof(addr));
+    ret = bind(listenFd, (struct sockaddr *)&addr, sizeof(addr));
     if(ret < 0) {
         LOG_ERROR("Bind Port:%d error!", port_);
-        close(listenFd_);
+        close(listenFd);
         return false;
     }
 
-    // 开始监听，6 排队建立3次握手队列和刚刚建立3次握手队列的链接数和，可以设置多一些，同一时刻可以处理更多请求
-    ret = listen(listenFd_, 6);
+    // 开始监听，backlog_为已完成3次握手、等待accept的连接队列长度(受net.core.somaxconn限制)
+    // 太小时连接风暴下内核会丢弃SYN，同一时刻可以处理更多请求
+    ret = listen(listenFd, backlog_);
     if(ret < 0) {
         LOG_ERROR("Listen port:%d error!", port_);
-        close(listenFd_);
+        close(listenFd);
         return false;
     }
 
-    // 将监听套接字上树
-    ret = epoller_->AddFd(listenFd_,  listenEvent_ | EPOLLIN);
+    // 将监听套接字上树，完成模式下直接提交accept
+    ret = loop->epoller->HasIo() ? loop->epoller->Accept(listenFd): loop->epoller->AddFd(listenFd,  listenEvent_ | EPOLLIN);
     if(ret == 0) {
         LOG_ERROR("Add listen error!");
-        close(listenFd_);
+        close(listenFd);
         return false;
     }
-    // 设置监听为非阻塞模式
-    SetFdNonblock(listenFd_);
+    loop->listenFd = listenFd;
     // 打印监听套接字端口号
-    LOG_INFO("Server port:%d", port_);
+    LOG_INFO("Server port:%d, loop[%d]", port_, loop->id);
     return true;
 }
 
+// 连接槽数量：MAX_FD与进程可打开文件数上限中较小的一个
+int WebServer::GetMaxFd_() {
+    struct rlimit rl;
+    if(getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY &&
+       rl.rlim_cur < static_cast<rlim_t>(MAX_FD)) {
+        return static_cast<int>(rl.rlim_cur);
+    }
+    return MAX_FD;
+}
+
+// 给SO_REUSEPORT组挂一段经典BPF程序：收包CPU等于某个事件循环绑定的CPU时选该循环的监听套接字，
+// 否则按CPU编号取模；套接字在组内的下标就是listen的顺序，也就是事件循环的编号
+bool WebServer::AttachCpuFilter_() {
+    assert(reactorMode_ == MULTI_REACTOR && !loops_.empty());
+    std::vector<struct sock_filter> code;
+    code.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS, static_cast<uint32_t>(SKF_AD_OFF + SKF_AD_CPU)));
+    for(auto& loop: loops_) {
+        code.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, static_cast<uint32_t>(loop->cpu), 0, 1));
+        code.push_back(BPF_STMT(BPF_RET | BPF_K, static_cast<uint32_t>(loop->id)));
+    }
+    code.push_back(BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, static_cast<uint32_t>(loops_.size())));
+    code.push_back(BPF_STMT(BPF_RET | BPF_A, 0));
+    struct sock_fprog prog;
+    prog.len = static_cast<unsigned short>(code.size());
+    prog.filter = code.data();
+    return setsockopt(loops_[0]->listenFd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) == 0;
+}
+
+// 解析"0-3,8"形式的CPU列表，列表为空时不绑核；语法错误或包含进程不可用的CPU时返回false且不绑核
+bool WebServer::ParseCpuList_(const char* list, std::vector<int>* cpus) {
+    assert(cpus);
+    cpus->clear();
+    if(!list || !*list) { return true; }
+    cpu_set_t allowed;
+    if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0) { return false; }
+    const char* p = list;
+    while(*p) {
+        char* end = nullptr;
+        long first = strtol(p, &end, 10);
+        if(end == p) { cpus->clear(); return false; }
+        long last = first;
+        if(*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if(end == p) { cpus->clear(); return false; }
+        }
+        if(first < 0 || last < first || last >= CPU_SETSIZE) { cpus->clear(); return false; }
+        for(long cpu = first; cpu <= last; cpu++) {
+            if(!CPU_ISSET(cpu, &allowed)) { cpus->clear(); return false; }
+            cpus->push_back(static_cast<int>(cpu));
+        }
+        if(*end == ',') { end++; }
+        else if(*end) { cpus->clear(); return false; }
+        p = end;
+    }
+    return true;
+}
+
+// 把当前线程绑定到cpu上
+bool WebServer::PinThread_(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
 // 设置文件描述符非阻塞
 int WebServer::SetFdNonblock(int fd) {
     assert(fd > 0);
@@ -367,8 +836,8 @@ int WebServer::SetFdNonblock(int fd) {
     // flag = flag  | O_NONBLOCK;
     // // flag  |= O_NONBLOCK;
     // fcntl(fd, F_SETFL, flag);
-    // 先获取状态，再或标志位
-    return fcntl(fd, F_SETFL, fcntl(fd, F_GETFD, 0) | O_NONBLOCK);
+    // 先获取文件状态标志(F_GETFL，而不是fd标志F_GETFD)，再或标志位
+    return fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
 }
 
 
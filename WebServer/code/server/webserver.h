@@ -3,72 +3,153 @@
 
 // 系统头文件
 #include <unordered_map> // C++风格的头文件
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
 #include <fcntl.h>       // fcntl()
 #include <unistd.h>      // close()
 #include <assert.h>
 #include <errno.h>       // 包含定义的表示不同错误码的宏
 #include <sys/socket.h>  // Linux的Socket编程
+#include <sys/eventfd.h> // eventfd()
+#include <sys/resource.h> // getrlimit()
+#include <sched.h>       // cpu_set_t
+#include <pthread.h>     // pthread_setaffinity_np()
+#include <linux/filter.h> // SO_ATTACH_REUSEPORT_CBPF使用的经典BPF指令
 #include <netinet/in.h>  // 包含Ipv4的结构体
 #include <arpa/inet.h>   // 网络字节序转换 
 
 // 自定义头文件
 #include "epoller.h"
+#include "sockopt.h"
 #include "../log/log.h"
 #include "../timer/heaptimer.h"
 #include "../pool/sqlconnpool.h"
 #include "../pool/threadpool.h"
 #include "../pool/sqlconnRAII.h"
 #include "../http/httpconn.h"
+#include "../cache/filecache.h"
+#include "../cache/filewatcher.h"
 
 class WebServer {
 public:
+    // Reactor模式
+    enum REACTOR_MODE {
+        SINGLE_REACTOR = 0, // 单Reactor：主线程负责epoll，读写交给线程池
+        MULTI_REACTOR,      // 多Reactor：每个线程一个事件循环，各自持有SO_REUSEPORT监听套接字，读写就地处理
+        MAIN_SUB_REACTOR,   // 主从Reactor：主Reactor负责accept，通过eventfd把连接交给从Reactor，读写就地处理
+    };
+
+    // 主从Reactor模式下新连接的分发策略
+    enum DISPATCH_MODE {
+        ROUND_ROBIN = 0,    // 轮询
+        LEAST_LOADED,       // 选择当前连接数最少的从Reactor
+        INCOMING_CPU,       // 交给绑定在收包CPU(SO_INCOMING_CPU)上的从Reactor，没有则轮询
+    };
+
     // 构造函数，传入参数为：端口号，epoll触发方式，超时时间，
     WebServer(
         int port, int trigMode, int timeoutMS, bool OptLinger,
         int sqlPort, const char* sqlUser, const  char* sqlPwd,
         const char* dbName, int connPoolNum, int threadNum,
-        bool openLog, int logLevel, int logQueSize);
-        /* 连接池数量 线程池数量 日志开关 日志等级 日志异步队列容量 */
+        bool openLog, int logLevel, int logQueSize,
+        int reactorMode = SINGLE_REACTOR, int dispatchMode = ROUND_ROBIN,
+        int ioBackend = Epoller::EPOLL, int backlog = 1024, int acceptBudget = 64,
+        int queueTargetMs = 5, const char* cpuList = nullptr, int maxPipeline = 16,
+        int maxHeaderBytes = 8192, int maxBodyBytes = 1024 * 1024, int fileCacheMB = 64,
+        int sendfileKB = 256, bool watchFiles = true);
+        /* 连接池数量 线程池数量(多Reactor模式下为事件循环数量，主从模式下为从Reactor数量) 日志开关 日志等级 日志异步队列容量
+           Reactor模式 新连接分发策略 事件后端 listen队列长度 每轮事件循环最多accept的连接数
+           线程池任务排队时间目标(毫秒，0为不做过载保护)
+           绑核的CPU列表(如"0-3,8"，按事件循环、线程池线程、日志线程的顺序依次分配，不够时循环使用；空为不绑核)
+           一个连接一批最多处理的流水线请求数 请求行加请求头的最大字节数(超过返回431) 请求体的最大字节数(超过返回413)
+           静态文件缓存的大小(MB，0为不缓存) 超过这个大小(KB)的文件不做映射，用sendfile发送(0为都映射) */
     ~WebServer();
     // 启动函数
     void Start();
 
 private:
-    bool InitSocket_();  // 初始化Socket
+    // 事件循环，每个循环独占一个epoll对象、定时器、监听套接字以及由它接收的连接
+    struct EventLoop {
+        int id;                                     // 循环编号
+        int cpu;                                    // 运行线程绑定的CPU，-1为不绑定
+        int listenFd;                               // 监听的文件描述符
+        std::unique_ptr<Epoller> epoller;           // epoll对象
+        std::unique_ptr<HeapTimer> timer;           // 定时器
+        // 以fd为下标的连接槽，大小固定为maxFd_，不会扩容；槽位在该fd第一次被使用时才分配，
+        // 之后一直复用，地址不变，定时器回调里保存的指针不会失效
+        std::vector<std::unique_ptr<HttpConn>> users;
+        std::atomic<int> connCount;                 // 分配给这个循环的连接数
+        std::atomic<uint64_t> accepted;             // 这个循环accept的连接数
+        std::atomic<uint64_t> rejected;             // 因连接数已满、过载或accept出错而拒绝的连接数
+        std::atomic<uint64_t> shed;                 // 过载时直接返回503的请求数
+        bool acceptPending;                         // 本轮accept预算用完，监听队列里可能还有连接
+
+        // 主从Reactor模式下从Reactor使用：主Reactor把新连接放入pending，再写wakeupFd唤醒
+        int wakeupFd;
+        std::mutex mtx;
+        std::vector<std::pair<int, sockaddr_in>> pending;
+    };
+
+    bool InitSocket_(EventLoop* loop);  // 初始化Socket
     void InitEventMode_(int trigMode);  // 设置时间触发方式，有边缘触发和水平触发
-    void AddClient_(int fd, sockaddr_in addr);  // 添加客户端
+    void AddClient_(EventLoop* loop, int fd, sockaddr_in addr);  // 添加客户端
+    HttpConn* GetConn_(EventLoop* loop, int fd);                // 取fd对应的连接槽
 
-    void DealListen_();                     // 处理监听
-    void DealWrite_(HttpConn* client);      // 处理写事件
-    void DealRead_(HttpConn* client);       // 处理读时间
+    void Loop_(EventLoop* loop);                            // 运行事件循环
+    void DealListen_(EventLoop* loop);                      // 处理监听
+    void AcceptClient_(EventLoop* loop, int fd, sockaddr_in addr);  // 检查并接纳一个新连接
+    void DealIo_(EventLoop* loop, int fd, const Epoller::IoEvent& io);  // 处理完成模式下的accept、接收和发送结果
+    void Dispatch_(int fd, sockaddr_in addr);               // 主Reactor把新连接交给从Reactor
+    void DealWakeup_(EventLoop* loop);                      // 从Reactor接收主Reactor交来的连接
+    void LogLoopStats_();                                   // 打印各事件循环的连接数和accept计数
+    bool AttachCpuFilter_();                                // 多Reactor模式下按收包CPU选择监听套接字
+    void DealWrite_(EventLoop* loop, HttpConn* client);     // 处理写事件
+    void DealRead_(EventLoop* loop, HttpConn* client);      // 处理读时间
 
     void SendError_(int fd, const char*info);   // 发送错误信息
-    void ExtentTime_(HttpConn* client);         // 延时函数？
-    void CloseConn_(HttpConn* client);          // 关闭连接
+    void ShedConn_(EventLoop* loop, HttpConn* client);      // 过载时以503拒绝连接上的新请求
+    void ExtentTime_(EventLoop* loop, HttpConn* client);    // 延时函数？
+    void CloseConn_(EventLoop* loop, HttpConn* client);     // 关闭连接
 
-    void OnRead_(HttpConn* client);
-    void OnWrite_(HttpConn* client);
-    void OnProcess(HttpConn* client);
+    void OnRead_(EventLoop* loop, HttpConn* client);
+    void OnWrite_(EventLoop* loop, HttpConn* client);
+    void OnSend_(EventLoop* loop, HttpConn* client);    // 完成模式下的写
+    void OnProcess(EventLoop* loop, HttpConn* client);
 
     static const int MAX_FD = 65536;    // 最大的文件描述符的个数
+    static int GetMaxFd_();             // MAX_FD与RLIMIT_NOFILE中较小的一个
+    static constexpr int STATS_INTERVAL_MS = 10000; // 0号事件循环打印各循环统计信息的间隔
+    static const int RETRY_AFTER_S = 1;         // 503响应中建议客户端重试的秒数
+    static const int DEFER_ACCEPT_S = 1;        // TCP_DEFER_ACCEPT等待客户端数据的秒数，0为不开启
+    static const int FASTOPEN_QLEN = 256;       // TCP_FASTOPEN队列长度，0为不开启
 
     static int SetFdNonblock(int fd);   // 设置文件描述符非阻塞
+    static bool ParseCpuList_(const char* list, std::vector<int>* cpus);  // 解析"0-3,8"形式的CPU列表
+    static bool PinThread_(int cpu);    // 把当前线程绑定到cpu上
 
+    int maxFd_;         // 连接槽的数量，fd不小于它的连接会被拒绝
     int port_;          // 端口
     bool openLinger_;   // 是否打开优雅关闭
     int timeoutMS_;  /* 毫秒MS */
-    bool isClose_;  // 是否关闭
-    int listenFd_;  // 监听的文件描述符
+    int backlog_;       // listen队列长度
+    int acceptBudget_;  // 每轮事件循环最多accept的连接数，避免连接风暴时饿死已建立的连接
+    std::atomic<bool> isClose_;  // 是否关闭，多个事件循环线程都会读取
+    int reactorMode_;   // Reactor模式
+    int dispatchMode_;  // 新连接分发策略
+    size_t nextLoop_;   // 轮询分发时下一个从Reactor的下标
+    std::vector<int> cpus_; // 绑核的CPU列表，为空时不绑核
     char* srcDir_;  // 资源的目录
+    std::string busyResponse_;  // 预先生成的完整503响应，过载和连接数已满时直接发送
 
     uint32_t listenEvent_;  // 监听的文件描述符的事件
     uint32_t connEvent_;    // 连接的文件描述符的事件
 
-    // 这三个 都是以指针的形式存在
-    std::unique_ptr<HeapTimer> timer_;  // 定时器
-    std::unique_ptr<ThreadPool> threadpool_;    // 线程池
-    std::unique_ptr<Epoller> epoller_;      // epoll对象
-    std::unordered_map<int, HttpConn> users_;   // 哈希表保存的是客户端连接的信息
+    std::unique_ptr<ThreadPool> threadpool_;    // 线程池，仅单Reactor模式使用
+    std::vector<std::unique_ptr<EventLoop>> loops_; // 事件循环，单Reactor模式下只有一个，主从模式下0号为主Reactor
+    std::vector<std::thread> loopThreads_;          // 除0号循环外，其余循环各自运行的线程
+    FileWatcher watcher_;                           // 资源目录的文件变化时让缓存失效
 };
 
 
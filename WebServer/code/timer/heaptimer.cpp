@@ -4,12 +4,12 @@
 // 向上调整节点，size_t i为索引
 void HeapTimer::siftup_(size_t i) {
     assert(i >= 0 && i < heap_.size());
-    size_t j = (i - 1) / 2; // 获取父节点索引
-    while(j >= 0) {
+    // 到根节点为止(i为0时(i - 1) / 2会回绕成很大的下标)
+    while(i > 0) {
+        size_t j = (i - 1) / 2; // 获取父节点索引
         if(heap_[j] < heap_[i]) { break; }
         SwapNode_(i, j);
         i = j;
-        j = (i - 1) / 2;
     }
 }
 // 交换节点
@@ -99,12 +99,12 @@ void HeapTimer::tick() {
         return;
     }
     while(!heap_.empty()) {
-        // 取出堆顶的节点
-        TimerNode node = heap_.front();
-        // 判断是否超时，若未超时，则直接退出
-        if(std::chrono::duration_cast<MS>(node.expires - Clock::now()).count() > 0) { 
+        // 判断堆顶的节点是否超时，若未超时，则直接退出；没超时时不拷贝节点(回调函数拷贝时会分配内存)
+        if(std::chrono::duration_cast<MS>(heap_.front().expires - Clock::now()).count() > 0) { 
             break; 
         }
+        // 取出堆顶的节点
+        TimerNode node = heap_.front();
         // 调用超时处理函数
         node.cb();
         // 将改定时器节点移出小根堆
@@ -5,7 +5,13 @@
  */ 
 #include "../code/log/log.h"
 #include "../code/pool/threadpool.h"
+#include "../code/http/httprequest.h"
+#include "../code/http/router.h"
+#include "../code/buffer/buffer.h"
+#include "../code/cache/filecache.h"
 #include <features.h>
+#include <cassert>
+#include <string>
 
 #if __GLIBC__ == 2 && __GLIBC_MINOR__ < 30
 #include <sys/syscall.h>
@@ -50,7 +56,325 @@ void TestThreadPool() {
     getchar();
 }
 
+// 一次收到全部数据
+HttpRequest::HTTP_CODE Parse(HttpRequest& request, Buffer& buff, const std::string& data) {
+    buff.Append(data);
+    return request.parse(buff);
+}
+
+// 一次只收到一个字节，最后一个字节到达之前都应该返回NO_REQUEST
+HttpRequest::HTTP_CODE ParseByByte(HttpRequest& request, Buffer& buff, const std::string& data) {
+    HttpRequest::HTTP_CODE code = HttpRequest::NO_REQUEST;
+    for(size_t i = 0; i < data.size(); i++) {
+        assert(code == HttpRequest::NO_REQUEST);
+        buff.Append(&data[i], 1);
+        code = request.parse(buff);
+    }
+    return code;
+}
+
+void TestHttpRequest() {
+    HttpRequest request;
+    Buffer buff;
+
+    // 请求行：方法、路径、版本直接从缓冲区切分，请求行之前的空行忽略
+    assert(Parse(request, buff, "\r\nHEAD /a/b.css HTTP/1.0\r\nHost:h\r\nX-Space:  v \r\nEmpty:\r\n\r\n")
+           == HttpRequest::GET_REQUEST);
+    assert(request.method() == "HEAD" && request.path() == "/a/b.css" && request.version() == "1.0");
+    // 冒号后最多跳过一个空格，其余原样保留
+    assert(request.GetHeader(HttpRequest::HOST) == "h");
+    assert(request.GetHeader("X-Space") == " v ");
+    assert(request.GetHeader("Empty").empty());
+    // HTTP/1.0即使带了keep-alive也不保持连接
+    assert(Parse(request, buff, "GET / HTTP/1.0\r\nConnection: keep-alive\r\n\r\n") == HttpRequest::GET_REQUEST);
+    assert(!request.IsKeepAlive());
+    assert(buff.ReadableBytes() == 0);
+
+    // 格式不对的请求行和请求头返回400
+    const char* badLines[] = {
+        "GET /index\r\n\r\n",
+        "GET  / HTTP/1.1\r\n\r\n",
+        "GET / HTTP/1.1 x\r\n\r\n",
+        "GET / FTP/1.1\r\n\r\n",
+        "GET / HTTP/1.1\r\nHost a\r\n\r\n",
+    };
+    for(const char* data: badLines) {
+        request.Init();
+        buff.RetrieveAll();
+        assert(Parse(request, buff, data) == HttpRequest::BAD_REQUEST);
+    }
+}
+
+void TestSizeLimit() {
+    HttpRequest request;
+    Buffer buff;
+
+    // 请求头超过maxHeaderBytes时不等它收完就返回431
+    std::string big(HttpRequest::maxHeaderBytes, 'a');
+    assert(Parse(request, buff, "GET / HTTP/1.1\r\nX: " + big) == HttpRequest::HEADER_TOO_LARGE);
+    request.Init();
+    buff.RetrieveAll();
+
+    // Content-Length超过maxBodyBytes时不等请求体到达就返回413
+    assert(Parse(request, buff, "POST /x HTTP/1.1\r\nContent-Length: "
+                 + std::to_string(HttpRequest::maxBodyBytes + 1) + "\r\n\r\n") == HttpRequest::ENTITY_TOO_LARGE);
+    request.Init();
+    buff.RetrieveAll();
+
+    // 请求体按Content-Length接收，分两次到达、中间有CRLF也完整，多余的数据属于下一个请求
+    assert(Parse(request, buff, "POST /x HTTP/1.1\r\nContent-Length: 7\r\n\r\nab\r\n") == HttpRequest::NO_REQUEST);
+    assert(Parse(request, buff, "cdeGET") == HttpRequest::GET_REQUEST);
+    assert(request.body() == "ab\r\ncde");
+    assert(buff.ReadableBytes() == 3);
+    request.Init();
+    buff.RetrieveAll();
+
+    // Content-Length不是十进制数返回400
+    assert(Parse(request, buff, "POST /x HTTP/1.1\r\nContent-Length: 1x\r\n\r\n") == HttpRequest::BAD_REQUEST);
+}
+
+void TestRouter() {
+    HttpRequest request;
+    Buffer buff;
+
+    // 登录和注册：不是表单时只返回页面，用户名为空时验证失败(不访问数据库)
+    assert(Parse(request, buff, "POST /login HTTP/1.1\r\nContent-Type: text/plain\r\nContent-Length: 1\r\n\r\na")
+           == HttpRequest::GET_REQUEST);
+    assert(request.path() == "/login.html");
+    std::string form = "username=&password=1";
+    assert(Parse(request, buff, "POST /register.html HTTP/1.1\r\nContent-Type: application/x-www-form-urlencoded\r\n"
+                 "Content-Length: " + std::to_string(form.size()) + "\r\n\r\n" + form) == HttpRequest::GET_REQUEST);
+    assert(request.GetPost("password") == "1");
+    assert(request.path() == "/error.html");
+    assert(Parse(request, buff, "GET /login HTTP/1.1\r\n\r\n") == HttpRequest::GET_REQUEST);
+    assert(request.path() == "/login.html");
+
+    // 内置页面：根目录是index.html，其他补上.html，不认识的路径不变
+    assert(Parse(request, buff, "GET / HTTP/1.1\r\n\r\n") == HttpRequest::GET_REQUEST);
+    assert(request.path() == "/index.html");
+    assert(Parse(request, buff, "HEAD /welcome HTTP/1.1\r\n\r\n") == HttpRequest::GET_REQUEST);
+    assert(request.path() == "/welcome.html");
+    assert(Parse(request, buff, "GET /welcome/ HTTP/1.1\r\n\r\n") == HttpRequest::GET_REQUEST);
+    assert(request.path() == "/welcome/");
+
+    // 注册的路由：静态段优先于参数，参数优先于通配，具体方法优先于ANY
+    Router* router = Router::Instance();
+    router->AddRoute(Router::ANY, "/api/:name", [](HttpRequest& req) {
+        req.path() = "/param-" + std::string(req.GetParam("name"));
+    });
+    router->AddRoute(Router::GET, "/api/status", [](HttpRequest& req) { req.path() = "/static"; });
+    router->AddRoute(Router::POST, "/api/:name", [](HttpRequest& req) { req.path() = "/post"; });
+    router->AddRoute(Router::ANY, "/files/*rest", [](HttpRequest& req) {
+        req.path() = "/rest-" + std::string(req.GetParam("rest"));
+    });
+    assert(Parse(request, buff, "GET /api/status HTTP/1.1\r\n\r\n") == HttpRequest::GET_REQUEST);
+    assert(request.path() == "/static");
+    assert(Parse(request, buff, "GET /api/user HTTP/1.1\r\n\r\n") == HttpRequest::GET_REQUEST);
+    assert(request.path() == "/param-user");
+    assert(Parse(request, buff, "POST /api/user HTTP/1.1\r\n\r\n") == HttpRequest::GET_REQUEST);
+    assert(request.path() == "/post");
+    assert(Parse(request, buff, "GET /files/a/b.txt HTTP/1.1\r\n\r\n") == HttpRequest::GET_REQUEST);
+    assert(request.path() == "/rest-a/b.txt");
+    assert(!router->AddRoute(Router::GET, "api", nullptr));
+    assert(!router->AddRoute(Router::GET, "/api/:other/x", nullptr));
+}
+
+void TestChunked() {
+    HttpRequest request;
+    Buffer buff;
+
+    std::string big(HttpRequest::maxHeaderBytes, 'a');
+    // chunked：块扩展忽略，trailer忽略，后面流水线的请求不受影响
+    std::string chunked = "POST /x HTTP/1.1\r\nTransfer-Encoding: gzip, Chunked\r\n\r\n"
+                          "3;name=value\r\nabc\r\n0A\r\n0123456789\r\n0\r\nExpires: 0\r\nX: y\r\n\r\n";
+    assert(ParseByByte(request, buff, chunked) == HttpRequest::GET_REQUEST);
+    assert(request.body() == "abc0123456789");
+    assert(buff.ReadableBytes() == 0);
+    assert(Parse(request, buff, chunked + "GET / HTTP/1.1\r\n\r\n") == HttpRequest::GET_REQUEST);
+    assert(request.body() == "abc0123456789");
+    assert(request.parse(buff) == HttpRequest::GET_REQUEST && request.path() == "/index.html");
+
+    // Transfer-Encoding和Content-Length同时出现、最后的编码不是chunked、块大小不对都返回400
+    const char* badChunked[] = {
+        "POST /x HTTP/1.1\r\nTransfer-Encoding: chunked\r\nContent-Length: 3\r\n\r\n3\r\nabc\r\n0\r\n\r\n",
+        "POST /x HTTP/1.1\r\nTransfer-Encoding: chunked, gzip\r\n\r\n",
+        "POST /x HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n",
+        "POST /x HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabcd\r\n",
+    };
+    for(const char* data: badChunked) {
+        request.Init();
+        buff.RetrieveAll();
+        assert(Parse(request, buff, data) == HttpRequest::BAD_REQUEST);
+    }
+
+    // 解码后超过maxBodyBytes返回413，很长的trailer返回431，大量的块扩展返回413
+    request.Init();
+    buff.RetrieveAll();
+    char size[32];
+    snprintf(size, sizeof(size), "%zx\r\n", HttpRequest::maxBodyBytes + 1);
+    assert(Parse(request, buff, "POST /x HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n" + std::string(size))
+           == HttpRequest::ENTITY_TOO_LARGE);
+    request.Init();
+    buff.RetrieveAll();
+    HttpRequest::HTTP_CODE code = Parse(request, buff, "POST /x HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n0\r\n");
+    for(int i = 0; i < 1000 && code == HttpRequest::NO_REQUEST; i++) { code = Parse(request, buff, "X: " + big + "\r\n"); }
+    assert(code == HttpRequest::HEADER_TOO_LARGE);
+    request.Init();
+    buff.RetrieveAll();
+    code = Parse(request, buff, "POST /x HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n");
+    for(int i = 0; i < 100000 && code == HttpRequest::NO_REQUEST; i++) {
+        code = Parse(request, buff, "1;" + std::string(100, 'e') + "\r\nx\r\n");
+    }
+    assert(code == HttpRequest::ENTITY_TOO_LARGE);
+    request.Init();
+    buff.RetrieveAll();
+
+    // 注册的路由：路径参数，请求体边收边交给请求体处理函数
+    std::string received;
+    Router::Instance()->AddRoute(Router::PUT, "/upload/:id", [](HttpRequest& req) {
+        req.path() = "/upload.html";
+    }, [&received](HttpRequest& req, std::string_view data) {
+        received += std::string(req.GetParam("id")) + ":" + std::string(data) + ";";
+    });
+    assert(ParseByByte(request, buff, "PUT /upload/7 HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                                      "2\r\nab\r\n1\r\nc\r\n0\r\n\r\n") == HttpRequest::GET_REQUEST);
+    assert(request.path() == "/upload.html");
+    assert(received == "7:a;7:b;7:c;");
+    received.clear();
+    assert(Parse(request, buff, "POST /login HTTP/1.1\r\nContent-Length: 1\r\n\r\na") == HttpRequest::GET_REQUEST);
+    assert(received.empty());
+}
+
+void TestHeaderTable() {
+    HttpRequest request;
+    Buffer buff;
+
+    // 已知的请求头不区分大小写
+    assert(Parse(request, buff, "POST /x HTTP/1.1\r\ncontent-LENGTH: 3\r\nCONNECTION: keep-alive\r\n"
+                                "if-none-match: \"e\"\r\nRANGE: bytes=0-1\r\nX-Custom: v\r\n\r\nabc")
+           == HttpRequest::GET_REQUEST);
+    assert(request.GetHeader(HttpRequest::CONTENT_LENGTH) == "3");
+    assert(request.GetHeader(HttpRequest::IF_NONE_MATCH) == "\"e\"");
+    assert(request.GetHeader(HttpRequest::RANGE) == "bytes=0-1");
+    assert(request.GetHeader(HttpRequest::HOST).empty());
+    assert(request.GetHeader("content-length") == "3");
+    assert(request.GetHeader("x-custom") == "v");
+    assert(request.IsKeepAlive() && request.body() == "abc");
+
+    // 请求头个数的上限是64个，第65个返回431
+    std::string headers;
+    for(int i = 0; i < 64; i++) { headers += "H" + std::to_string(i) + ": v\r\n"; }
+    assert(Parse(request, buff, "GET / HTTP/1.1\r\n" + headers + "\r\n") == HttpRequest::GET_REQUEST);
+    assert(request.GetHeader("H63") == "v");
+    request.Init();
+    buff.RetrieveAll();
+    assert(Parse(request, buff, "GET / HTTP/1.1\r\n" + headers + "H64: v\r\n\r\n") == HttpRequest::HEADER_TOO_LARGE);
+}
+
+void TestPipeline() {
+    HttpRequest request;
+    Buffer buff;
+
+    // 流水线：一次收到两个完整的请求和第三个请求的开头，多余的数据留在缓冲区
+    std::string second = "POST /picture HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello";
+    std::string rest = "GET /vid";
+    assert(Parse(request, buff, "GET / HTTP/1.0\r\n\r\n" + second + rest) == HttpRequest::GET_REQUEST);
+    assert(request.path() == "/index.html" && !request.IsKeepAlive());
+    assert(buff.ReadableBytes() == second.size() + rest.size());
+    assert(request.parse(buff) == HttpRequest::GET_REQUEST);
+    assert(request.path() == "/picture.html" && request.body() == "hello");
+    assert(buff.ReadableBytes() == rest.size());
+    assert(Parse(request, buff, "eo HTTP/1.1\r\n\r\n") == HttpRequest::GET_REQUEST);
+    assert(request.path() == "/video.html");
+    assert(buff.ReadableBytes() == 0);
+}
+
+void TestParseResume() {
+    HttpRequest request;
+    Buffer buff;
+
+    // 空缓冲区
+    assert(request.parse(buff) == HttpRequest::NO_REQUEST);
+
+    // 请求被拆成一个字节一个字节
+    assert(ParseByByte(request, buff, "GET /index HTTP/1.1\r\nHost: a\r\nConnection: keep-alive\r\n\r\n")
+           == HttpRequest::GET_REQUEST);
+    assert(request.method() == "GET" && request.version() == "1.1");
+    assert(request.path() == "/index.html");
+    assert(request.IsKeepAlive());
+    assert(buff.ReadableBytes() == 0);
+
+    // 不完整的请求不消耗数据，后面的数据到达后从停下的位置继续
+    assert(Parse(request, buff, "GET /pic") == HttpRequest::NO_REQUEST);
+    assert(buff.ReadableBytes() == 8);
+    assert(Parse(request, buff, "ture HTTP/1.1\r\nHost: a") == HttpRequest::NO_REQUEST);
+    assert(Parse(request, buff, "\r\n\r") == HttpRequest::NO_REQUEST);
+    assert(Parse(request, buff, "\n") == HttpRequest::GET_REQUEST);
+    assert(request.path() == "/picture.html" && request.GetHeader(HttpRequest::HOST) == "a");
+    assert(buff.ReadableBytes() == 0);
+}
+
+void WriteFile(const char* path, const std::string& content, mode_t mode) {
+    FILE* fp = fopen(path, "w");
+    assert(fp);
+    fwrite(content.data(), 1, content.size(), fp);
+    fclose(fp);
+    chmod(path, mode);
+}
+
+void TestFileCache() {
+    const char* path = "./testcache.txt";
+    FileCache* cache = FileCache::Instance();
+
+    // 打开缓存：第二次取到同一个条目，失效后重新打开
+    cache->Init(1 << 20);
+    WriteFile(path, "abc", 0644);
+    FileCache::FilePtr file = cache->Get(path);
+    assert(file && file->data && std::string(file->data, file->st.st_size) == "abc");
+    assert(cache->Get(path) == file);
+    WriteFile(path, "abcd", 0644);
+    cache->Invalidate(path);
+    assert(cache->Get(path)->st.st_size == 4);
+
+    // 第一次要gzip版本时在后台压缩，不等压缩完成，先返回nullptr
+    WriteFile(path, std::string(4096, 'a'), 0644);
+    cache->Invalidate(path);
+    file = cache->Get(path);
+    FileCache::FilePtr gzip = cache->GetGzip(file);
+    for(int i = 0; i < 1000 && !gzip; i++) {
+        usleep(1000);
+        gzip = cache->GetGzip(file);
+    }
+    assert(gzip && std::string(gzip->encoding) == "gzip" && gzip->st.st_size < 4096);
+    assert(cache->GetGzip(file) == gzip);
+
+    // 关闭缓存：每次都重新打开，包括空文件和没有读权限的文件
+    cache->Init(0);
+    WriteFile(path, "", 0644);
+    file = cache->Get(path);
+    assert(file && file->st.st_size == 0);
+    assert(cache->Get(path) != file);
+    WriteFile(path, "hello", 0644);
+    file = cache->Get(path);
+    assert(file->st.st_size == 5 && std::string(file->data, 5) == "hello");
+    WriteFile(path, "", 0600);
+    assert(cache->Get(path)->data == nullptr);
+    chmod(path, 0644);
+    assert(cache->Get(path)->data != nullptr);
+
+    unlink(path);
+    assert(cache->Get(path) == nullptr);
+}
+
 int main() {
+    TestHttpRequest();
+    TestParseResume();
+    TestPipeline();
+    TestHeaderTable();
+    TestChunked();
+    TestRouter();
+    TestSizeLimit();
+    TestFileCache();
     TestLog();
     TestThreadPool();
 }
\ No newline at end of file